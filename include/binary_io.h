@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <vector>
+#include "edgefriend.h"
+
+// Versioned binary container of an EdgefriendGeometry that can be memory-mapped and used in place.
+//
+// Layout (little-endian): a 128-byte header, then positions, indices, friendsAndSharpnesses and
+// valenceStartInfos as raw arrays, each starting at a multiple of 64 bytes.
+namespace BinaryIO {
+
+constexpr std::uint32_t geometryVersion = 1;
+
+// Read-only view of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::filesystem::path& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::span<const std::byte> Bytes() const { return { data, size }; }
+
+private:
+    void Close();
+
+    const std::byte* data = nullptr;
+    std::size_t size = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+void WriteGeometry(const std::filesystem::path& path,
+                   const Edgefriend::EdgefriendGeometry& geometry,
+                   int level);
+
+// Serialized form of WriteGeometry, e.g. for caches that store blobs.
+std::vector<std::byte> SerializeGeometry(const Edgefriend::EdgefriendGeometry& geometry, int level);
+
+// Checks the header of a serialized geometry and that every index, friend and valence start stays inside the
+// arrays, then returns views into bytes. Whether the friends close the rings is not checked: a damaged file
+// cannot make the kernels read out of bounds, but their ring walks over it may not terminate.
+// Throws std::runtime_error if bytes do not hold a geometry of this version.
+Edgefriend::EdgefriendGeometryView ViewGeometry(std::span<const std::byte> bytes, int* level = nullptr);
+
+// A geometry file mapped into memory; the view stays valid as long as the object lives.
+// Pass View() to Edgefriend::SubdivideEdgefriendGeometry to continue refining without a copy.
+class MappedGeometry {
+public:
+    explicit MappedGeometry(const std::filesystem::path& path);
+
+    int Level() const { return level; }
+    const Edgefriend::EdgefriendGeometryView& View() const { return view; }
+    Edgefriend::EdgefriendGeometry Copy() const;
+
+private:
+    MappedFile file;
+    Edgefriend::EdgefriendGeometryView view;
+    int level = 0;
+};
+
+} // namespace BinaryIO
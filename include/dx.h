@@ -16,6 +16,8 @@ public:
     void Run();
     bool RunAndCompareWithCpu(float positionEpsilon = 2e-5f);
     void SetIters(int i);
+    void SetLimitProjection(bool enabled);
+    void SetDisplacementMap(const std::filesystem::path& path, int resolution, float scale);
 
 private:
     static constexpr UINT kComputeThreadsPerGroup = 32;
@@ -55,11 +57,16 @@ private:
 
     // --- Configuration ---
     int m_iters = 1;
+    bool m_limitProjection = false;
+    std::filesystem::path m_displacementPath;
+    int m_displacementResolution = 0;
+    float m_displacementScale = 1.0f;
     std::filesystem::path m_objPath = "spot_quadrangulated.obj";
 
     // --- Geometry data ---
     Edgefriend::EdgefriendGeometry m_inputGeometry;
     Edgefriend::EdgefriendGeometry m_resultGeometry;
+    Edgefriend::DisplacementMap m_displacement;
 
     // --- DX12 core objects ---
     Microsoft::WRL::ComPtr<ID3D12Device>              m_device;
@@ -124,4 +131,7 @@ private:
     void LoadObj();
     void PreallocateResult(int iterations, const Edgefriend::EdgefriendGeometry& input);
     Edgefriend::EdgefriendGeometry RunCpuSubdivision() const;
+    bool CompareFaceVaryingWithVertexPath(float positionEpsilon) const;
+    bool CompareLimitNormalsWithFinerLevel() const;
+    void FinalizeGeometry(Edgefriend::EdgefriendGeometry& geometry) const;
 };
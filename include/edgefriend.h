@@ -1,9 +1,16 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <limits>
+#include <span>
 #include <vector>
 #include <unordered_dense.h>
 
 #include <glm/glm.hpp>
+#include <glm/ext/vector_uint2_sized.hpp>
 #include <glm/gtx/hash.hpp>
 
 namespace Edgefriend {
@@ -14,12 +21,413 @@ namespace Edgefriend {
 		std::vector<int>        valenceStartInfos;
 	};
 
+	// Read-only arrays of one level, laid out like EdgefriendGeometry.
+	struct EdgefriendGeometryView {
+		std::span<const glm::vec3>  positions;
+		std::span<const int>        indices;
+		std::span<const glm::uvec4> friendsAndSharpnesses;
+		std::span<const int>        valenceStartInfos;
+	};
+
+	// Levels 0 to `levels` of a level-0 geometry. Each array keeps all levels back to back in one allocation,
+	// about 4/3 of the finest level, and every level is refined straight into its slot.
+	// Throws std::out_of_range if the levels do not fit the 32-bit numbering.
+	class EdgefriendPyramid {
+	public:
+		EdgefriendPyramid() = default;
+		EdgefriendPyramid(const EdgefriendGeometry& base, int levels);
+
+		int LevelCount() const { return offsets.empty() ? 0 : int(offsets.size()) - 1; }
+		EdgefriendGeometryView Level(int level) const;
+		EdgefriendGeometry Copy(int level) const;
+
+	private:
+		struct LevelOffsets {
+			std::size_t positions = 0;
+			std::size_t indices = 0;
+			std::size_t friendsAndSharpnesses = 0;
+			std::size_t valenceStartInfos = 0;
+		};
+
+		std::vector<glm::vec3>    positions;
+		std::vector<int>          indices;
+		std::vector<glm::uvec4>   friendsAndSharpnesses;
+		std::vector<int>          valenceStartInfos;
+		std::vector<LevelOffsets> offsets; // first element of every level, plus the end
+	};
+
+	// A block of N float channels per vertex (texcoords, colors, skinning weights, ...) refined with the
+	// same face, edge and vertex rules as the positions. Interleave all channels of a mesh into one block
+	// so a single pass over the topology refines all of them.
+	// The refinement entry points below are instantiated for 1 to 16 channels.
+	template<int N>
+	struct Primvar {
+		std::array<float, N> values{};
+
+		float& operator[](int i) { return values[i]; }
+		const float& operator[](int i) const { return values[i]; }
+
+		Primvar& operator+=(const Primvar& other) {
+			for (int i = 0; i < N; ++i) values[i] += other.values[i];
+			return *this;
+		}
+		Primvar& operator*=(float s) {
+			for (int i = 0; i < N; ++i) values[i] *= s;
+			return *this;
+		}
+		Primvar& operator/=(float s) {
+			for (int i = 0; i < N; ++i) values[i] /= s;
+			return *this;
+		}
+	};
+
+	template<int N>
+	Primvar<N> operator+(Primvar<N> a, const Primvar<N>& b) { return a += b; }
+	template<int N>
+	Primvar<N> operator*(Primvar<N> a, float s) { return a *= s; }
+	template<int N>
+	Primvar<N> operator*(float s, Primvar<N> a) { return a *= s; }
+	template<int N>
+	Primvar<N> operator/(Primvar<N> a, float s) { return a /= s; }
+
 	EdgefriendGeometry SubdivideToEdgefriendGeometry(
 		std::vector<glm::vec3> positions,
 		std::vector<int> indices,
 		std::vector<int> indicesOffsets,
 		ankerl::unordered_dense::map<glm::ivec2, float> sharpEdges);
 
+	// Same as above, additionally refining one primvar block per input vertex into newPrimvars.
+	template<int N>
+	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+		std::vector<glm::vec3> positions,
+		std::vector<int> indices,
+		std::vector<int> indicesOffsets,
+		ankerl::unordered_dense::map<glm::ivec2, float> sharpEdges,
+		const std::vector<Primvar<N>>& primvars,
+		std::vector<Primvar<N>>& newPrimvars);
+
 	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old);
+	// Refines a level without copying it first, e.g. a pyramid level or a memory-mapped file.
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometryView& old);
+
+	// Same refinement with a prefix-stable vertex numbering: vertex v of old keeps index v (now at its refined
+	// position), the face point and the two edge points created by quad f follow at oV + 3f, oV + 3f + 1 and
+	// oV + 3f + 2. Index buffers of coarser levels stay valid on finer vertex buffers, so switching to a finer
+	// level only updates the old prefix and appends the rest. Slots from oV + 3 * quads on are unused.
+	// The quad and friend numbering is the usual one.
+	EdgefriendGeometry SubdivideEdgefriendGeometryPrefixStable(const EdgefriendGeometry& old);
+
+	struct BoundingBox {
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+	};
+
+	// Bounding hierarchy of the refined mesh, one quadtree per level-0 quad: boxes[k][q] encloses every new
+	// quad below quad q of level k, boxes[level] the new quads themselves. Set level to the level of the new mesh.
+	struct PatchBounds {
+		int level = 1;
+		std::vector<std::vector<BoundingBox>> boxes;
+	};
+
+	// Also builds the bounding hierarchy of the new mesh. The boxes of the new quads come from the refinement
+	// itself and are conservative: each encloses the old one-ring the quad was refined from, not just its corners.
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old, PatchBounds& bounds);
+
+	// Hashes of a mesh for regression checks across builds and machines, per block of blockSize level-0 quads
+	// and over all blocks. Topology (indices, friends and sharpnesses) is hashed exactly, positions after
+	// rounding to a grid of tolerance, walking the corners of the quads so unused vertex slots do not count.
+	// A position within float noise of a grid cell border may still round either way.
+	// Set level, tolerance and blockSize before passing it in.
+	struct GeometryFingerprint {
+		int level = 1; // levels between the level-0 quads and the fingerprinted quads
+		float tolerance = 1e-5f;
+		int blockSize = 64;
+		std::uint64_t topology = 0;
+		std::uint64_t positions = 0;
+		std::vector<std::uint64_t> blockTopology;
+		std::vector<std::uint64_t> blockPositions;
+	};
+
+	void ComputeFingerprint(const EdgefriendGeometry& geometry, GeometryFingerprint& fingerprint);
+
+	// Also fingerprints the new mesh, with fingerprint.level the level of the new mesh.
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old, GeometryFingerprint& fingerprint);
+
+	// Refines the primvars alongside the positions in the same pass over the topology.
+	template<int N>
+	EdgefriendGeometry SubdivideEdgefriendGeometry(
+		const EdgefriendGeometry& old,
+		const std::vector<Primvar<N>>& oldPrimvars,
+		std::vector<Primvar<N>>& newPrimvars);
+
+	enum class FaceVaryingInterpolation {
+		Linear,     // bilinear inside every face, no smoothing at all
+		Boundaries, // smooth inside UV islands, seams and mesh borders use the crease rule, seam corners stay put
+	};
+
+	// Face-varying data (UVs) stored per corner, parallel to EdgefriendGeometry::indices.
+	// seams mirrors the sharpness slots of friendsAndSharpnesses: x for the edge to friend 0, y for friend 1.
+	template<int N>
+	struct FaceVaryingPrimvar {
+		std::vector<Primvar<N>>  values;
+		std::vector<glm::u8vec2> seams;
+		FaceVaryingInterpolation interpolation = FaceVaryingInterpolation::Boundaries;
+	};
+
+	// Level 0 for face-varying data: values are indexed per input corner by valueIndices (the OBJ texcoord
+	// indices), edges whose corners use different value indices on both sides become seams.
+	template<int N>
+	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+		std::vector<glm::vec3> positions,
+		std::vector<int> indices,
+		std::vector<int> indicesOffsets,
+		ankerl::unordered_dense::map<glm::ivec2, float> sharpEdges,
+		const std::vector<Primvar<N>>& values,
+		const std::vector<int>& valueIndices,
+		FaceVaryingPrimvar<N>& newFaceVarying);
+
+	template<int N>
+	EdgefriendGeometry SubdivideEdgefriendGeometry(
+		const EdgefriendGeometry& old,
+		const FaceVaryingPrimvar<N>& oldFaceVarying,
+		FaceVaryingPrimvar<N>& newFaceVarying);
+
+	// Position on the level-0 quads, one per corner of every input polygon. A quad q of a mesh refined
+	// `level` times beyond level 0 lies inside level-0 quad q >> (2 * level).
+	struct SurfaceCoordinate {
+		int   baseQuad = -1;
+		float u = 0.f;
+		float v = 0.f;
+	};
+
+	// Coordinate of a vertex inside the quad its valence start corner belongs to.
+	SurfaceCoordinate ComputeSurfaceCoordinate(const EdgefriendGeometry& geometry, int vertex, int level);
+
+	// --- quad hierarchy: quad q of a level is child q % 4 of quad q / 4 one level up ---
+	inline int ParentQuad(int quad) { return quad / 4; }
+	inline int ChildQuad(int quad, int child) { return 4 * quad + child; }
+	inline int BaseQuad(int quad, int level) { return quad >> (2 * level); }
+
+	// Square of its level-0 quad covered by a quad `level` levels below: corner 0 sits at (u, v), the quad
+	// parameter (s, t) maps to (u, v) + size * (s, t) turned by `rotation` quarter turns counterclockwise.
+	struct QuadAddress {
+		int   baseQuad = -1;
+		float u = 0.f;
+		float v = 0.f;
+		float size = 1.f;
+		int   rotation = 0;
+	};
+
+	QuadAddress ComputeQuadAddress(int quad, int level);
+
+	// Input polygon of every level-0 quad: level-0 quad q is split from corner q of the input indices.
+	// Quads past the input corners close borders and get -1.
+	std::vector<int> ComputeBaseQuadFaces(const std::vector<int>& indicesOffsets, int nIndices, int nBaseQuads);
+
+	// Per-quad uniform attributes (material ids, groups, ...) one level down, every child keeps its parent's value.
+	template<typename T>
+	std::vector<T> PropagateQuadAttribute(const std::vector<T>& attributes) {
+		std::vector<T> result(4 * attributes.size());
+		for (std::size_t quad = 0; quad < result.size(); ++quad) {
+			result[quad] = attributes[quad / 4];
+		}
+		return result;
+	}
+
+	// Straight from the level-0 quads to a quad `level` levels below.
+	template<typename T>
+	std::vector<T> PropagateQuadAttribute(const std::vector<T>& baseAttributes, int level) {
+		std::vector<T> result(baseAttributes.size() << (2 * level));
+		for (std::size_t quad = 0; quad < result.size(); ++quad) {
+			result[quad] = baseAttributes[quad >> (2 * level)];
+		}
+		return result;
+	}
+
+	// Raw float32 displacement, one tile of resolution x resolution texels per level-0 quad, rows along v.
+	// One channel displaces along the limit normal, three channels are an object space offset.
+	// Shared vertices sample the tile of their valence start quad, so tiles should agree along their borders.
+	struct DisplacementMap {
+		int   resolution = 0;
+		int   channels = 1;
+		float scale = 1.f;
+		std::vector<float> texels;
+	};
+
+	// Refines a level-0 geometry `levels` times, like calling SubdivideEdgefriendGeometry in a loop.
+	// Positions inside regular, crease-free level-0 quads are evaluated directly from their bicubic
+	// B-spline patch; the kernel only refines positions around the irregular quads.
+	EdgefriendGeometry SubdivideEdgefriendGeometryHybrid(const EdgefriendGeometry& base, int levels);
+
+	struct AnytimeSubdivision {
+		EdgefriendGeometry geometry;
+		int level = 0; // levels refined beyond the input
+		std::future<EdgefriendGeometry> refined; // level maxLevel, if it is still being computed in the background
+	};
+
+	// Refines up to maxLevel times, but only starts a level if its cost, predicted from the measured throughput of
+	// the previous level (the previous call for the first one), fits into what is left of the budget.
+	// The first call of a process times one refinement of a small cube instead, within the budget.
+	// With continueInBackground the remaining levels are refined on another thread.
+	AnytimeSubdivision SubdivideEdgefriendGeometryWithin(EdgefriendGeometry geometry, int maxLevel, std::chrono::nanoseconds budget, bool continueInBackground = false);
+
+	// Points on the mesh refined `level` times beyond the level-0 geometry base, at arbitrary coordinates on
+	// the level-0 quads: bilinear inside the level-`level` quad containing each coordinate. Only the quads
+	// around the queries are refined, with the same kernels as SubdivideEdgefriendGeometry, so a few thousand
+	// queries cost a few thousand local descents instead of a whole level.
+	// Throws std::out_of_range if the level does not fit the 32-bit numbering of the refined mesh.
+	std::vector<glm::vec3> SampleSubdivisionSurface(const EdgefriendGeometry& base, int level,
+		const std::vector<SurfaceCoordinate>& coordinates);
+
+	// Polygons in the input layout of SubdivideToEdgefriendGeometry.
+	struct PolygonMesh {
+		std::vector<glm::vec3> positions;
+		std::vector<int>       indices;
+		std::vector<int>       indicesOffsets;
+	};
+
+	// Level per level-0 quad: the first level at which a further refinement step would move the points of
+	// the quad less than tolerance off its plane, estimated from one step on the level-0 positions. At most maxLevel.
+	std::vector<int> ComputeAdaptiveLevels(const EdgefriendGeometry& base, float tolerance, int maxLevel);
+
+	// Refines every level-0 quad to its own level, only the quads of each face and the halo the kernels read.
+	// Vertices shared by quads of different levels take the position of the finest one, and coarser quads get
+	// the vertices of their finer neighbours inserted along the shared edge, so the mesh stays watertight and
+	// faces along level transitions have more than four corners.
+	PolygonMesh SubdivideEdgefriendGeometryAdaptive(const EdgefriendGeometry& base, const std::vector<int>& levels);
+
+	// Connected components of the faces, found with a lock-free union-find over their vertices.
+	// Components are numbered in the order of their first face.
+	struct MeshComponents {
+		int count = 0;
+		std::vector<int> faceComponents;
+	};
+
+	MeshComponents FindConnectedComponents(const std::vector<int>& indices, const std::vector<int>& indicesOffsets,
+		std::size_t vertexCount);
+
+	// Preprocesses every group of faces (faceGroups[face] in 0 .. groupCount - 1) as its own mesh and refines it
+	// `levels` times, all groups concurrently. Each result only holds the vertices its faces use, and its
+	// level-0 quads follow the corners of the group's faces in input order. Groups sharing an edge are split along
+	// it, so use connected components for the result of the whole mesh, or shapes for one geometry per shape.
+	std::vector<EdgefriendGeometry> SubdivideFaceGroups(
+		const PolygonMesh& mesh,
+		const ankerl::unordered_dense::map<glm::ivec2, float>& sharpEdges,
+		const std::vector<int>& faceGroups, int groupCount, int levels);
+
+	// Concatenates geometries into one, offsetting vertex indices, friends and valence starts.
+	// The result refines like its parts.
+	EdgefriendGeometry MergeEdgefriendGeometries(const std::vector<EdgefriendGeometry>& parts);
+
+	// SubdivideFaceGroups over the connected components, merged. Level-0 quads are ordered by component,
+	// so they only follow the input corners if the mesh is a single component.
+	EdgefriendGeometry SubdivideByComponents(
+		const PolygonMesh& mesh,
+		const ankerl::unordered_dense::map<glm::ivec2, float>& sharpEdges,
+		int levels);
+
+	// Cluster of the final level for mesh shaders, at most 64 vertices and 126 triangles.
+	// triangleOffset counts bytes of MeshletMesh::triangles, three local vertex indices per triangle.
+	// Backface culling: skip the meshlet if dot(normalize(coneApex - eye), coneAxis) >= coneCutoff.
+	struct Meshlet {
+		std::uint32_t vertexOffset = 0;
+		std::uint32_t vertexCount = 0;
+		std::uint32_t triangleOffset = 0;
+		std::uint32_t triangleCount = 0;
+
+		glm::vec3 center{ 0.f };
+		float     radius = 0.f;
+		glm::vec3 coneApex{ 0.f };
+		glm::vec3 coneAxis{ 0.f };
+		float     coneCutoff = 1.f;
+	};
+
+	struct MeshletMesh {
+		std::vector<Meshlet>       meshlets;
+		std::vector<std::uint32_t> vertices;  // indices into EdgefriendGeometry::positions
+		std::vector<std::uint8_t>  triangles; // indices into the vertices of their meshlet
+	};
+
+	// Splits every quad into two triangles and packs them into meshlets in quad order, where the children of a
+	// quad are consecutive. Chunks of the quad range are packed in parallel, no global clustering pass.
+	MeshletMesh BuildMeshlets(const EdgefriendGeometry& geometry);
+
+	// Two triangles per quad of a mesh `level` levels below level 0, three vertex indices each. The quads of every
+	// level-0 quad are ordered along a Hilbert curve over its sub-squares, level-0 quads are exported in parallel.
+	std::vector<std::uint32_t> ExportTriangles(const EdgefriendGeometry& geometry, int level);
+
+	struct VertexCacheStatistics {
+		std::size_t transformedVertices = 0;
+		float acmr = 0.f; // transformed vertices per triangle
+		float atvr = 0.f; // transformed vertices per referenced vertex, 1 is optimal
+	};
+
+	// Simulates a FIFO post-transform cache over a triangle list.
+	VertexCacheStatistics AnalyzeVertexCache(const std::vector<std::uint32_t>& triangles, std::size_t vertexCount,
+		int cacheSize = 32);
+
+	// Stores levels[0] (a level-0 geometry) as is and every finer level as the difference between its positions and
+	// SubdivideEdgefriendGeometry of the previous reconstructed level, quantized to `step` and Rice coded.
+	// The topology of the finer levels is not stored. Every level has to have the topology of the refined previous one.
+	std::vector<std::uint8_t> EncodeDetailPyramid(const std::vector<EdgefriendGeometry>& levels, float step);
+
+	// Reconstructs the given level by refining and adding the residuals, the finest level if level is negative.
+	// Throws std::out_of_range if the data holds fewer levels.
+	// Coarser levels only read the front of the data, so it can be loaded progressively.
+	EdgefriendGeometry DecodeDetailPyramid(const std::vector<std::uint8_t>& bytes, int level = -1);
+
+	struct GeometryDifference {
+		struct Offender {
+			std::size_t vertex = 0;
+			float error = 0.f; // largest absolute coordinate difference
+			std::uint32_t ulps = 0;
+		};
+
+		bool sizesMatch = true; // otherwise only the common prefix of every array is compared
+		std::size_t comparedVertices = 0; // vertices a uses
+		std::size_t positionMismatches = 0; // vertices with a coordinate differing by more than the epsilon
+		std::size_t indexMismatches = 0;
+		std::size_t friendMismatches = 0; // quads whose friends or sharpnesses differ
+		std::size_t valenceStartMismatches = 0;
+		float maxError = 0.f;
+		double meanError = 0.0;
+		double rmsError = 0.0;
+		std::uint32_t maxUlps = 0;
+		std::vector<Offender> worst; // largest errors first
+
+		bool Matches() const {
+			return sizesMatch && positionMismatches == 0 && indexMismatches == 0 && friendMismatches == 0 &&
+				valenceStartMismatches == 0;
+		}
+	};
+
+	// Compares two geometries in parallel: positions within positionEpsilon per coordinate, everything else exactly.
+	// Errors are per vertex, the largest absolute coordinate difference or NaN; vertex slots a does not use count as equal.
+	GeometryDifference CompareGeometry(const EdgefriendGeometry& a, const EdgefriendGeometry& b,
+		float positionEpsilon = 2e-5f, int worstCount = 8);
+
+	// Optional per-vertex outputs of the limit evaluation; null streams are skipped.
+	struct LimitSurfaceStreams {
+		std::vector<glm::vec3>* positions = nullptr;
+		std::vector<glm::vec3>* normals   = nullptr;
+		std::vector<glm::vec3>* tangents  = nullptr;
+
+		std::vector<SurfaceCoordinate>* coordinates = nullptr;
+		const DisplacementMap* displacement = nullptr; // offsets the limit positions
+		int level = 0; // refinement levels beyond level 0, needed for coordinates and displacement
+	};
+
+	// Evaluates limit positions, normals and tangents of every vertex with one weighted ring walk per vertex.
+	// Normals, tangents and displacement along the normal need the valence first, which costs one more walk.
+	void EvaluateLimitSurface(const EdgefriendGeometry& geometry, const LimitSurfaceStreams& streams);
+
+	// Moves every vertex onto the Catmull-Clark limit surface in a single pass over the final level,
+	// which usually makes one more refinement level unnecessary. Limit normals come from the same pass.
+	void ProjectToLimitSurface(EdgefriendGeometry& geometry, std::vector<glm::vec3>* normals = nullptr);
+
+	// Same pass as ProjectToLimitSurface, additionally applying the displacement map.
+	// The normals are those of the undisplaced limit surface.
+	void DisplaceLimitSurface(EdgefriendGeometry& geometry, int level, const DisplacementMap& displacement,
+		std::vector<glm::vec3>* normals = nullptr);
 
 }
\ No newline at end of file
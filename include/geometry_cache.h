@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include "edgefriend.h"
+#include "obj_io.h"
+
+namespace BinaryIO {
+
+// Bump whenever SubdivideToEdgefriendGeometry changes its output, so stale entries are never hit.
+constexpr std::uint32_t cacheVersion = 1;
+
+// Persistent cache of level-0 geometries in one directory, one BinaryIO geometry file per input mesh named
+// after a hash of its positions, indices, face offsets and creases. Entries are replaced atomically, so
+// several processes can share a directory. The least recently used entries are evicted once the directory
+// holds more than maxBytes.
+class GeometryCache {
+public:
+    struct Statistics {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        std::uintmax_t bytes = 0; // size of the directory after the last store
+    };
+
+    GeometryCache(std::filesystem::path directory, std::uintmax_t maxBytes);
+
+    // The level-0 geometry of mesh, from the cache or computed and stored. Failing to store it is not an error.
+    Edgefriend::EdgefriendGeometry Load(const ObjIO::RawMesh& mesh);
+
+    Statistics GetStatistics() const;
+
+    // Independent of the order in which the creases were read.
+    static std::uint64_t Key(const ObjIO::RawMesh& mesh);
+
+private:
+    std::filesystem::path EntryPath(std::uint64_t key) const;
+    void Store(std::uint64_t key, const Edgefriend::EdgefriendGeometry& geometry);
+    void Evict();
+
+    std::filesystem::path directory;
+    std::uintmax_t maxBytes;
+    mutable std::mutex mutex;
+    Statistics statistics;
+};
+
+} // namespace BinaryIO
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtx/hash.hpp>
+#include "unordered_dense.h"
+#include "edgefriend.h"
+
+// Conventional half-edge Catmull-Clark, the reference the Edgefriend kernels are measured and validated against.
+// Same rules as Edgefriend: borders are closed with one extra face per border loop, creases use the same
+// smooth/crease/corner blend and lose one unit of sharpness per level.
+namespace HalfEdge {
+
+struct Mesh {
+    std::vector<glm::vec3> positions;
+    // per half-edge
+    std::vector<int> origins;
+    std::vector<int> nexts;
+    std::vector<int> prevs;
+    std::vector<int> twins;
+    std::vector<int> faces;
+    std::vector<float> sharpnesses;
+    // half-edges of face f are faceOffsets[f] .. faceOffsets[f + 1] - 1, in corner order
+    std::vector<int> faceOffsets;
+    std::vector<int> vertexHalfEdges; // one outgoing half-edge per vertex, -1 if the vertex is unused
+    // half-edges of the input faces; the faces closing the borders come after them
+    int realHalfEdges = 0;
+};
+
+// Half-edge i of the input is corner i of indices. Throws std::invalid_argument on non-manifold input.
+Mesh BuildMesh(const std::vector<glm::vec3>& positions,
+               const std::vector<int>& indices,
+               const std::vector<int>& indicesOffsets,
+               const ankerl::unordered_dense::map<glm::ivec2, float>& creases);
+
+// One level. Vertex points keep their index, face points follow, then edge points. The quad refining
+// half-edge h is face h, and its half-edges are 4h .. 4h + 3 starting at the old corner, so quads are
+// numbered like the Edgefriend quads of the same level.
+Mesh SubdivideMesh(const Mesh& mesh);
+
+std::size_t MemoryBytes(const Mesh& mesh);
+std::size_t MemoryBytes(const Edgefriend::EdgefriendGeometry& geometry);
+
+struct Comparison {
+    int levels = 0;
+    std::size_t comparedQuads = 0; // quads refining input faces, border-closing faces are not compared
+    std::size_t mismatches = 0;    // quads with a corner further apart than the tolerance
+    float maxError = 0.f;
+    double edgefriendSeconds = 0.0;
+    double halfEdgeSeconds = 0.0;
+    std::size_t edgefriendBytes = 0; // both engines at the finest level
+    std::size_t halfEdgeBytes = 0;
+};
+
+// Refines the input `levels` times with both engines and compares the corners of every quad.
+Comparison CompareWithEdgefriend(const std::vector<glm::vec3>& positions,
+                                 const std::vector<int>& indices,
+                                 const std::vector<int>& indicesOffsets,
+                                 const ankerl::unordered_dense::map<glm::ivec2, float>& creases,
+                                 int levels,
+                                 float tolerance);
+
+} // namespace HalfEdge
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
 #include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtx/hash.hpp>
@@ -11,15 +12,36 @@ namespace ObjIO {
 
 struct RawMesh {
     std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> colors; // per position, empty if the file has no vertex colors
     std::vector<int> indices;
     std::vector<int> indicesOffsets;
+    std::vector<int> materialIds; // per face, empty if the file references no material library
+    // face-varying, one texcoord index per entry of indices; both empty if any corner lacks a texcoord
+    std::vector<glm::vec2> texcoords;
+    std::vector<int> texcoordIndices;
     ankerl::unordered_dense::map<glm::ivec2, float> creases;
+    // faces of all shapes in file order, shape i starts at face shapeFaceOffsets[i]
+    std::vector<int> shapeFaceOffsets;
+    std::vector<std::string> shapeNames;
 };
 
 RawMesh LoadRawMesh(const std::filesystem::path& path);
 
+// Reads raw float32 displacement tiles (see Edgefriend::DisplacementMap).
+Edgefriend::DisplacementMap LoadDisplacementMap(const std::filesystem::path& path,
+                                                int resolution, int channels = 1);
+
+// Formats blocks of lines in parallel. precision is the number of significant digits of the positions
+// (1 to 9, 6 like std::ostream), 0 writes the shortest text that reads back to the same floats.
 void WriteGeometry(const std::filesystem::path& path,
-                   const Edgefriend::EdgefriendGeometry& geometry);
+                   const Edgefriend::EdgefriendGeometry& geometry,
+                   int precision = 6);
+
+// Triangle list as returned by Edgefriend::ExportTriangles.
+void WriteTriangles(const std::filesystem::path& path,
+                    const Edgefriend::EdgefriendGeometry& geometry,
+                    const std::vector<std::uint32_t>& triangles,
+                    int precision = 6);
 
 bool CompareFiles(const std::filesystem::path& pathA,
                   const std::filesystem::path& pathB,
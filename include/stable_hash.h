@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Hash for values that outlive the process, such as cache keys and fingerprints.
+// Frozen copy of wyhash (https://github.com/wangyi-fudan/wyhash, public domain) with fixed seed and secret,
+// reading little-endian words, so results do not change with the version of unordered_dense.
+namespace StableHash {
+
+std::uint64_t Hash(const void* data, std::size_t size);
+
+} // namespace StableHash
@@ -17,6 +17,18 @@ int main(int argc, char** argv)
 			if (arg == "--check") {
 				checkMode = true;
 			}
+			else if (arg == "--limit") {
+				dx.SetLimitProjection(true);
+			}
+			else if (arg == "--displace") {
+				if (i + 3 >= argc) {
+					throw std::invalid_argument("Expected <file> <resolution> <scale> after --displace.");
+				}
+				const std::string path = argv[++i];
+				const int resolution = std::stoi(argv[++i]);
+				const float scale = std::stof(argv[++i]);
+				dx.SetDisplacementMap(path, resolution, scale);
+			}
 			else if (arg == "--eps") {
 				if (i + 1 >= argc) {
 					throw std::invalid_argument("Missing value after --eps.");
@@ -0,0 +1,279 @@
+#include "binary_io.h"
+#include <algorithm>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace BinaryIO {
+
+namespace {
+
+constexpr char geometryMagic[8] = { 'E', 'F', 'G', 'E', 'O', 'M', '\0', '\0' };
+constexpr std::size_t arrayAlignment = 64;
+
+struct GeometryHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::int32_t level;
+    std::uint64_t counts[4];  // elements of positions, indices, friendsAndSharpnesses, valenceStartInfos
+    std::uint64_t offsets[4]; // bytes from the start of the header
+    std::uint8_t reserved[48];
+};
+static_assert(sizeof(GeometryHeader) == 128);
+
+constexpr std::size_t elementSizes[4] = { sizeof(glm::vec3), sizeof(int), sizeof(glm::uvec4), sizeof(int) };
+
+std::size_t AlignUp(std::size_t value) {
+    return (value + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+}
+
+GeometryHeader MakeHeader(const Edgefriend::EdgefriendGeometry& geometry, int level) {
+    GeometryHeader header{};
+    std::memcpy(header.magic, geometryMagic, sizeof(geometryMagic));
+    header.version = geometryVersion;
+    header.level = level;
+    header.counts[0] = geometry.positions.size();
+    header.counts[1] = geometry.indices.size();
+    header.counts[2] = geometry.friendsAndSharpnesses.size();
+    header.counts[3] = geometry.valenceStartInfos.size();
+
+    std::size_t offset = sizeof(GeometryHeader);
+    for (int i = 0; i < 4; ++i) {
+        offset = AlignUp(offset);
+        header.offsets[i] = offset;
+        offset += header.counts[i] * elementSizes[i];
+    }
+    return header;
+}
+
+std::size_t FileSize(const GeometryHeader& header) {
+    return header.offsets[3] + header.counts[3] * elementSizes[3];
+}
+
+// Calls write(bytes, size) for the header, every array and the padding between them.
+template<typename Write>
+void WriteSections(const Edgefriend::EdgefriendGeometry& geometry, int level, Write write) {
+    const GeometryHeader header = MakeHeader(geometry, level);
+    const void* arrays[4] = { geometry.positions.data(), geometry.indices.data(),
+                              geometry.friendsAndSharpnesses.data(), geometry.valenceStartInfos.data() };
+    const char padding[arrayAlignment] = {};
+
+    write(&header, sizeof(header));
+    std::size_t offset = sizeof(header);
+    for (int i = 0; i < 4; ++i) {
+        write(padding, header.offsets[i] - offset);
+        write(arrays[i], header.counts[i] * elementSizes[i]);
+        offset = header.offsets[i] + header.counts[i] * elementSizes[i];
+    }
+}
+
+// The kernels index without bounds checks, so every stored reference has to stay inside the arrays.
+void CheckReferences(const Edgefriend::EdgefriendGeometryView& view) {
+    const int nV = int(view.positions.size());
+    const std::uint32_t nQ = std::uint32_t(view.friendsAndSharpnesses.size());
+
+    const bool indicesValid = std::all_of(std::execution::par, view.indices.begin(), view.indices.end(),
+        [&](int vertex) { return vertex >= 0 && vertex < nV; });
+    // friend words 0 and 2 are 2 * quad + side, 1 and 3 sharpnesses
+    const bool friendsValid = std::all_of(std::execution::par, view.friendsAndSharpnesses.begin(), view.friendsAndSharpnesses.end(),
+        [&](const glm::uvec4& friends) { return friends[0] / 2 < nQ && friends[2] / 2 < nQ; });
+    // unused vertices hold the marker
+    const bool valenceStartsValid = std::all_of(std::execution::par, view.valenceStartInfos.begin(), view.valenceStartInfos.end(),
+        [&](int corner) { return (corner >= 0 && std::uint32_t(corner) < 4 * nQ) || corner == 0x7fffffff; });
+
+    if (!indicesValid || !friendsValid || !valenceStartsValid) {
+        throw std::runtime_error("Geometry references are out of range.");
+    }
+}
+
+} // anonymous namespace
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+    file = handle;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize)) {
+        Close();
+        throw std::runtime_error("Failed to query file size: " + path.string());
+    }
+    size = static_cast<std::size_t>(fileSize.QuadPart);
+    if (size == 0) {
+        return;
+    }
+
+    mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        Close();
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+    data = static_cast<const std::byte*>(view);
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::runtime_error("Failed to open file: " + path.string());
+    }
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0) {
+        close(descriptor);
+        throw std::runtime_error("Failed to query file size: " + path.string());
+    }
+    size = static_cast<std::size_t>(status.st_size);
+    if (size == 0) {
+        close(descriptor);
+        return;
+    }
+
+    void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (view == MAP_FAILED) {
+        size = 0;
+        throw std::runtime_error("Failed to map file: " + path.string());
+    }
+    data = static_cast<const std::byte*>(view);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        Close();
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+#ifdef _WIN32
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+    if (file) {
+        CloseHandle(file);
+    }
+    file = nullptr;
+    mapping = nullptr;
+#else
+    if (data) {
+        munmap(const_cast<std::byte*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+void WriteGeometry(const std::filesystem::path& path,
+                   const Edgefriend::EdgefriendGeometry& geometry,
+                   int level) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + path.string());
+    }
+    WriteSections(geometry, level, [&](const void* bytes, std::size_t size) {
+        out.write(static_cast<const char*>(bytes), size);
+    });
+    if (!out) {
+        throw std::runtime_error("Failed to write output file: " + path.string());
+    }
+}
+
+std::vector<std::byte> SerializeGeometry(const Edgefriend::EdgefriendGeometry& geometry, int level) {
+    std::vector<std::byte> bytes;
+    bytes.reserve(FileSize(MakeHeader(geometry, level)));
+    WriteSections(geometry, level, [&](const void* data, std::size_t size) {
+        auto begin = static_cast<const std::byte*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    });
+    return bytes;
+}
+
+Edgefriend::EdgefriendGeometryView ViewGeometry(std::span<const std::byte> bytes, int* level) {
+    GeometryHeader header;
+    if (bytes.size() < sizeof(header)) {
+        throw std::runtime_error("Geometry data is truncated.");
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if (std::memcmp(header.magic, geometryMagic, sizeof(geometryMagic)) != 0) {
+        throw std::runtime_error("Not an Edgefriend geometry.");
+    }
+    if (header.version != geometryVersion) {
+        throw std::runtime_error("Unsupported geometry version " + std::to_string(header.version) + ".");
+    }
+    // mapped files are page aligned, blobs in memory at least element aligned
+    if (reinterpret_cast<std::uintptr_t>(bytes.data()) % alignof(glm::uvec4) != 0) {
+        throw std::runtime_error("Geometry data is not aligned.");
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (header.offsets[i] % arrayAlignment != 0 || header.offsets[i] > bytes.size() ||
+            header.counts[i] > (bytes.size() - header.offsets[i]) / elementSizes[i]) {
+            throw std::runtime_error("Geometry data is truncated.");
+        }
+    }
+    if (header.counts[1] != 4 * header.counts[2] || header.counts[3] != header.counts[0]) {
+        throw std::runtime_error("Geometry arrays do not match.");
+    }
+    // the kernels address the bytes of a level in 32-bit ints
+    if (4 * std::max(header.counts[0], header.counts[1]) > 0x7fffffff) {
+        throw std::runtime_error("Geometry exceeds the 32-bit numbering.");
+    }
+
+    if (level) {
+        *level = header.level;
+    }
+    const auto At = [&](int i) { return bytes.data() + header.offsets[i]; };
+    Edgefriend::EdgefriendGeometryView view = {
+        { reinterpret_cast<const glm::vec3*>(At(0)), header.counts[0] },
+        { reinterpret_cast<const int*>(At(1)), header.counts[1] },
+        { reinterpret_cast<const glm::uvec4*>(At(2)), header.counts[2] },
+        { reinterpret_cast<const int*>(At(3)), header.counts[3] } };
+    CheckReferences(view);
+    return view;
+}
+
+MappedGeometry::MappedGeometry(const std::filesystem::path& path)
+    : file(path) {
+    view = ViewGeometry(file.Bytes(), &level);
+}
+
+Edgefriend::EdgefriendGeometry MappedGeometry::Copy() const {
+    return {
+        { view.positions.begin(), view.positions.end() },
+        { view.indices.begin(), view.indices.end() },
+        { view.friendsAndSharpnesses.begin(), view.friendsAndSharpnesses.end() },
+        { view.valenceStartInfos.begin(), view.valenceStartInfos.end() } };
+}
+
+} // namespace BinaryIO
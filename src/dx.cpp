@@ -9,6 +9,7 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <cmath>
 #include <limits>
 #include <fstream>
 #include <sstream>
@@ -86,6 +87,17 @@ void EdgefriendDX12::SetIters(int i) {
     m_iters = i;
 }
 
+void EdgefriendDX12::SetLimitProjection(bool enabled) {
+    m_limitProjection = enabled;
+}
+
+void EdgefriendDX12::SetDisplacementMap(const std::filesystem::path& path, int resolution, float scale) {
+    if (resolution <= 0) throw std::invalid_argument("displacement resolution must be > 0.");
+    m_displacementPath = path;
+    m_displacementResolution = resolution;
+    m_displacementScale = scale;
+}
+
 // ============================================================================
 // Public entry points
 // ============================================================================
@@ -101,6 +113,7 @@ void EdgefriendDX12::Run() {
 
     ExecuteSubdivisions();
     ReadBackResults();
+    FinalizeGeometry(m_resultGeometry);
 
     const auto outputPath = "output_" + std::to_string(m_iters) + "iter.obj";
     ObjIO::WriteGeometry(outputPath, m_resultGeometry);
@@ -113,17 +126,117 @@ bool EdgefriendDX12::RunAndCompareWithCpu(float positionEpsilon) {
 
     Run();
 
-    const auto dx12Path = "output_" + std::to_string(m_iters) + "iter.obj";
-    const auto cpuPath  = "output_cpp_" + std::to_string(m_iters) + "iter.obj";
-
     const auto cpuResult = RunCpuSubdivision();
-    ObjIO::WriteGeometry(cpuPath, cpuResult);
+    const auto difference = Edgefriend::CompareGeometry(m_resultGeometry, cpuResult, positionEpsilon);
+
+    std::cout << "[Check] Compared DX12 and C++ results in memory (epsilon=" << positionEpsilon << ")\n"
+              << "[Check] " << difference.comparedVertices << " vertices, max error " << difference.maxError
+              << " (" << difference.maxUlps << " ulps), mean " << difference.meanError
+              << ", rms " << difference.rmsError << '\n';
+    if (!difference.sizesMatch) {
+        std::cerr << "[Check] Array sizes differ.\n";
+    }
 
-    const bool match = ObjIO::CompareFiles(dx12Path, cpuPath, positionEpsilon);
-    std::cout << "[Check] Compared: " << dx12Path << " vs " << cpuPath
-              << " (epsilon=" << positionEpsilon << ")\n"
-              << (match ? "[Check] DX12 and C++ outputs are consistent.\n"
+    const bool match = difference.Matches();
+    if (!match) {
+        std::cerr << "[Check] Mismatches: " << difference.positionMismatches << " positions, "
+                  << difference.indexMismatches << " indices, " << difference.friendMismatches << " friends, "
+                  << difference.valenceStartMismatches << " valence starts\n";
+        for (const auto& offender : difference.worst) {
+            std::cerr << "[Check]   vertex " << offender.vertex << ": error " << offender.error
+                      << " (" << offender.ulps << " ulps)\n";
+        }
+    }
+    std::cout << (match ? "[Check] DX12 and C++ outputs are consistent.\n"
                         : "[Check] DX12 and C++ outputs differ.\n");
+
+    const bool faceVaryingMatch = CompareFaceVaryingWithVertexPath(positionEpsilon);
+    const bool normalsMatch = CompareLimitNormalsWithFinerLevel();
+    return match && faceVaryingMatch && normalsMatch;
+}
+
+// The limit normal of every vertex has to point to the same side as the surface one level finer, including
+// at creases and corners where it comes from the fan of ring edges.
+bool EdgefriendDX12::CompareLimitNormalsWithFinerLevel() const {
+    auto geometry = m_inputGeometry;
+    for (int i = 0; i < m_iters; ++i) {
+        geometry = Edgefriend::SubdivideEdgefriendGeometry(geometry);
+    }
+    std::vector<glm::vec3> normals(geometry.positions.size());
+    Edgefriend::LimitSurfaceStreams streams;
+    streams.normals = &normals;
+    Edgefriend::EvaluateLimitSurface(geometry, streams);
+
+    // area-weighted quad normals one level finer, where old vertex v sits at 4v or 3 * quads + v
+    const auto finer = Edgefriend::SubdivideEdgefriendGeometry(geometry);
+    std::vector<glm::vec3> finerNormals(finer.positions.size(), glm::vec3(0.0f));
+    for (std::size_t quad = 0; quad < finer.friendsAndSharpnesses.size(); ++quad) {
+        const int* corners = &finer.indices[4 * quad];
+        const glm::vec3 normal = glm::cross(finer.positions[corners[2]] - finer.positions[corners[0]],
+                                            finer.positions[corners[3]] - finer.positions[corners[1]]);
+        for (int i = 0; i < 4; ++i) {
+            finerNormals[corners[i]] += normal;
+        }
+    }
+
+    const std::size_t nQ = geometry.friendsAndSharpnesses.size();
+    std::size_t checked = 0;
+    std::size_t flipped = 0;
+    for (std::size_t vertex = 0; vertex < geometry.positions.size(); ++vertex) {
+        const int corner = geometry.valenceStartInfos[vertex];
+        if (corner < 0 || std::size_t(corner) >= 4 * nQ || std::size_t(geometry.indices[corner]) != vertex) {
+            continue;
+        }
+        const std::size_t finerVertex = (vertex > nQ) ? 3 * nQ + vertex : 4 * vertex;
+        ++checked;
+        flipped += glm::dot(normals[vertex], finerNormals[finerVertex]) <= 0.0f;
+    }
+    std::cout << "[Check] Limit normals against the finer level: " << flipped << " of " << checked
+              << " vertices point away.\n";
+    return flipped == 0;
+}
+
+// Positions as a face-varying primvar indexed by the position indices have no seams, so every corner has
+// to refine to the value of its vertex refined as a vertex primvar.
+bool EdgefriendDX12::CompareFaceVaryingWithVertexPath(float positionEpsilon) const {
+    auto raw = ObjIO::LoadRawMesh(m_objPath);
+    std::vector<Edgefriend::Primvar<3>> values(raw.positions.size());
+    for (std::size_t v = 0; v < values.size(); ++v) {
+        values[v] = { raw.positions[v].x, raw.positions[v].y, raw.positions[v].z };
+    }
+
+    std::vector<Edgefriend::Primvar<3>> vertexValues, nextVertexValues;
+    Edgefriend::FaceVaryingPrimvar<3> cornerValues, nextCornerValues;
+    auto vertexGeometry = Edgefriend::SubdivideToEdgefriendGeometry<3>(
+        raw.positions, raw.indices, raw.indicesOffsets, raw.creases, values, vertexValues);
+    auto cornerGeometry = Edgefriend::SubdivideToEdgefriendGeometry<3>(
+        raw.positions, raw.indices, raw.indicesOffsets, raw.creases, values, raw.indices, cornerValues);
+
+    // borders are face-varying seams but smooth across the closing faces in the vertex path
+    if (std::any_of(cornerValues.seams.begin(), cornerValues.seams.end(),
+                    [](glm::u8vec2 seams) { return seams != glm::u8vec2(0); })) {
+        std::cout << "[Check] Face-varying check skipped, the mesh has borders.\n";
+        return true;
+    }
+
+    for (int i = 0; i < m_iters; ++i) {
+        vertexGeometry = Edgefriend::SubdivideEdgefriendGeometry<3>(vertexGeometry, vertexValues, nextVertexValues);
+        cornerGeometry = Edgefriend::SubdivideEdgefriendGeometry<3>(cornerGeometry, cornerValues, nextCornerValues);
+        std::swap(vertexValues, nextVertexValues);
+        std::swap(cornerValues, nextCornerValues);
+    }
+
+    float maxError = 0.0f;
+    for (std::size_t corner = 0; corner < cornerGeometry.indices.size(); ++corner) {
+        const auto& vertexValue = vertexValues[vertexGeometry.indices[corner]];
+        for (int i = 0; i < 3; ++i) {
+            const float error = std::abs(cornerValues.values[corner][i] - vertexValue[i]);
+            maxError = (std::isnan(error) || error > maxError) ? error : maxError;
+        }
+    }
+    const bool match = cornerGeometry.indices == vertexGeometry.indices && maxError <= positionEpsilon;
+    std::cout << "[Check] Face-varying and vertex primvars: max error " << maxError
+              << (match ? ", consistent.\n" : ", differ.\n");
     return match;
 }
 
@@ -136,6 +249,11 @@ void EdgefriendDX12::LoadObj() {
     m_inputGeometry = Edgefriend::SubdivideToEdgefriendGeometry(
         std::move(raw.positions), std::move(raw.indices),
         std::move(raw.indicesOffsets), std::move(raw.creases));
+
+    if (!m_displacementPath.empty()) {
+        m_displacement = ObjIO::LoadDisplacementMap(m_displacementPath, m_displacementResolution);
+        m_displacement.scale = m_displacementScale;
+    }
 }
 
 void EdgefriendDX12::PreallocateResult(int iterations, const Edgefriend::EdgefriendGeometry& input) {
@@ -161,9 +279,20 @@ Edgefriend::EdgefriendGeometry EdgefriendDX12::RunCpuSubdivision() const {
     for (int i = 0; i < m_iters; ++i) {
         cpuGeometry = Edgefriend::SubdivideEdgefriendGeometry(cpuGeometry);
     }
+    FinalizeGeometry(cpuGeometry);
     return cpuGeometry;
 }
 
+void EdgefriendDX12::FinalizeGeometry(Edgefriend::EdgefriendGeometry& geometry) const {
+    // displacement samples the limit surface, so it replaces the plain projection
+    if (!m_displacement.texels.empty()) {
+        Edgefriend::DisplaceLimitSurface(geometry, m_iters, m_displacement);
+    }
+    else if (m_limitProjection) {
+        Edgefriend::ProjectToLimitSurface(geometry);
+    }
+}
+
 // ============================================================================
 // DX12 initialization
 // ============================================================================
@@ -1,19 +1,111 @@
 #include <edgefriend.h>
+#include <stable_hash.h>
 #include <atomic>
+#include <future>
 #include <algorithm>
 #include <execution>
 #include <ranges>
+#include <numeric>
+#include <numbers>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
 
 #define EXECUTION_POLICY std::execution::par
 
 #include <fstream>
 
 namespace Edgefriend {
-	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+	// Extra per-vertex data refined next to the positions. Kernels take streams by value,
+	// so the ring sums of each vertex thread live in its own copy.
+	template<typename T>
+	struct PrimvarStream {
+		const std::vector<T>* old = nullptr;
+		std::vector<T>* neu = nullptr;
+
+		T ringE{};
+		T ringF{};
+		T sharpA{};
+		T sharpB{};
+	};
+
+	// Per-corner data refined next to the positions. The ring state belongs to the walk around one vertex.
+	template<typename T>
+	struct FaceVaryingStream {
+		const std::vector<T>* old = nullptr;
+		const std::vector<glm::u8vec2>* oldSeams = nullptr;
+		const std::vector<int>* oldIndices = nullptr; // level 0 only: value index per input corner
+		std::vector<T>* neu = nullptr;
+		std::vector<glm::u8vec2>* newSeams = nullptr;
+		FaceVaryingInterpolation interpolation = FaceVaryingInterpolation::Boundaries;
+
+		T ringE{};
+		T ringF{};
+		T sharpA{};
+		T sharpB{};
+		int seamCount = 0;
+		int seamCorners[2] = { -1, -1 }; // corners whose crossed edge is a seam
+	};
+
+	// Conservative boxes of the new quads. Child 4f+i starts at the vertex point of corner i of quad f, and all of
+	// its corners lie in the convex hull of that vertex's one-ring, so the vertex thread writes the ring box to
+	// the children of each of its corners.
+	struct BoundsStream {
+		const std::vector<glm::vec3>* old = nullptr;
+		std::vector<BoundingBox>* neu = nullptr;
+
+		BoundingBox ring;
+	};
+
+	// Restricts position refinement to the descendants of some base quads, topology is always refined.
+	struct PositionMask {
+		const std::vector<std::uint8_t>* activeBaseQuads = nullptr;
+		int level = 0; // levels between the base quads and the quads being refined
+
+		int stableVertices = -1; // old vertex count when the new vertices are numbered prefix-stable
+
+		bool Active(int quad) const {
+			return !activeBaseQuads || (*activeBaseQuads)[quad >> (2 * level)];
+		}
+
+		// Maps a new vertex of the edgefriend numbering (4v or 3oF+v for old vertices, 4f+1..3 for the
+		// points of quad f) to the prefix-stable one (v, then oV+3f..oV+3f+2). The unused tail stays put.
+		int Renumber(int vertex, int oF) const {
+			if (stableVertices < 0) {
+				return vertex;
+			}
+			if (vertex <= 4 * oF) {
+				return (vertex % 4 == 0) ? vertex / 4 : stableVertices + 3 * (vertex / 4) + vertex % 4 - 1;
+			}
+			return (vertex < 3 * oF + stableVertices) ? vertex - 3 * oF : vertex;
+		}
+	};
+
+	template<typename Stream>
+	constexpr bool IsFaceVarying = false;
+	template<typename T>
+	constexpr bool IsFaceVarying<FaceVaryingStream<T>> = true;
+
+	// Level 0 refines face-varying streams in their own passes, everything else goes through fn.
+	template<typename Stream, typename Fn>
+	void IfPrimvar(Stream& stream, Fn&& fn) {
+		if constexpr (!IsFaceVarying<Stream>) {
+			fn(stream);
+		}
+	}
+
+	template<int N>
+	Primvar<N> lerp(const Primvar<N>& a, const Primvar<N>& b, float value) {
+		return a * (1.f - value) + b * value;
+	}
+
+	template<typename... Streams>
+	EdgefriendGeometry SubdivideToEdgefriendGeometryImpl(
 		std::vector<glm::vec3> oldPositions,
 		std::vector<int> oldIndices,
 		std::vector<int> oldIndicesOffsets,
-		ankerl::unordered_dense::map<glm::ivec2, float> oldCreases) {
+		ankerl::unordered_dense::map<glm::ivec2, float> oldCreases,
+		Streams... streams) {
 		using Edge = glm::ivec2;
 		struct EdgeSide {
 			int face = -1;
@@ -117,6 +209,11 @@ namespace Edgefriend {
 
 		std::size_t nG = 0;
 
+		// border faces are appended below, face-varying data reads their corners from the real face they copy
+		const std::size_t nRealFaces = oldIndicesOffsets.size();
+		const std::size_t nRealCorners = oldIndices.size();
+		std::vector<std::size_t> ghostCornerSources;
+
 		std::vector<int> newFace;
 		newFace.reserve(borders.size());
 
@@ -132,6 +229,9 @@ namespace Edgefriend {
 			EdgeSide cur = start;
 			do {
 				newFace.push_back(oldIndices[oldIndicesOffsets[cur.face] + cur.corner]);
+
+				std::size_t source = oldIndicesOffsets[cur.face] + cur.corner;
+				ghostCornerSources.push_back((source < nRealCorners) ? source : ghostCornerSources[source - nRealCorners]);
 				cur = Prev(GetCCWTillBorder(cur));
 			} while (cur.face != start.face || cur.corner != start.corner);
 
@@ -164,6 +264,8 @@ namespace Edgefriend {
 
 		std::vector<std::atomic<EdgeSide>> vertexStart(oV);
 
+		(IfPrimvar(streams, [&](auto& stream) { stream.neu->assign(nV, {}); }), ...);
+
 		// --- compute face-points, topology, friends and valence start info ---
 		auto faceView = std::views::iota(0ull, oF);
 		std::for_each(EXECUTION_POLICY, faceView.begin(), faceView.end(), [&](int face) {
@@ -174,6 +276,7 @@ namespace Edgefriend {
 
 				vertexStart[v] = { face, slot };
 				newPositions[fp] += oldPositions[v];
+				(IfPrimvar(streams, [&](auto& stream) { (*stream.neu)[fp] += (*stream.old)[v]; }), ...);
 
 				int prev = Index(face, (slot + faceSize - 1) % faceSize);
 				int next = Index(face, (slot + 1) % faceSize);
@@ -213,6 +316,7 @@ namespace Edgefriend {
 				newFriendsAndSharpnesses[cornerId] = glm::uvec4(friend0, 0, friend1, glm::floatBitsToUint(glm::max(0.f, Sharpness(prevEdgeUnique) - 1.f)));
 			}
 			newPositions[fp] /= faceSize;
+			(IfPrimvar(streams, [&](auto& stream) { (*stream.neu)[fp] /= float(faceSize); }), ...);
 			});
 
 		// --- compute edge-points ---
@@ -228,6 +332,16 @@ namespace Edgefriend {
 
 			float sharpness = Sharpness(edge);
 			newPositions[oV + id] = glm::mix(smooth, sharp, glm::min(1.f, sharpness));
+
+			[[maybe_unused]] const auto RefineEdge = [&](auto& stream) {
+				const auto& va = (*stream.old)[edge.x];
+				const auto& vb = (*stream.old)[edge.y];
+
+				auto smoothValue = (va + vb + (*stream.neu)[oV + oE + a.face] + (*stream.neu)[oV + oE + b.face]) * .25f;
+				auto sharpValue = (va + vb) * .5f;
+				(*stream.neu)[oV + id] = lerp(smoothValue, sharpValue, glm::min(1.f, sharpness));
+				};
+			(IfPrimvar(streams, RefineEdge), ...);
 			});
 
 		// --- update vertex-points ---
@@ -242,14 +356,20 @@ namespace Edgefriend {
 			glm::vec3 Q(0, 0, 0);
 			glm::vec3 R(0, 0, 0);
 
-			glm::vec3 sharpA;
-			glm::vec3 sharpB;
+			glm::vec3 sharpA{};
+			glm::vec3 sharpB{};
 
 			int   sharpCount = 0;
 			float sharpnessSum = 0.f;
 
 			std::size_t n = 0;
 
+			// per-thread copies of the streams hold their ring sums
+			auto rings = std::make_tuple(streams...);
+			const auto ForEachRing = [&](auto&& fn) {
+				std::apply([&](auto&... stream) { (IfPrimvar(stream, fn), ...); }, rings);
+				};
+
 			auto f_ = f;
 			auto slot_ = slot;
 			do {
@@ -264,6 +384,14 @@ namespace Edgefriend {
 				float sharpness = Sharpness(edge);
 				const auto& [id, a, b] = edgeMap[edge];
 
+				ForEachRing([&](auto& stream) {
+					stream.ringE += (*stream.old)[r] + (*stream.old)[v];
+					stream.ringF += (*stream.neu)[oV + oE + f_];
+					if (sharpness > 0) {
+						((sharpCount == 0) ? stream.sharpA : stream.sharpB) = (*stream.old)[r];
+					}
+					});
+
 				sharpnessSum += sharpness;
 				if (sharpness > 0) {
 					((sharpCount == 0) ? sharpA : sharpB) = posE;
@@ -295,8 +423,195 @@ namespace Edgefriend {
 			}
 
 			newPositions[v] = vertexPoint;
+
+			ForEachRing([&](auto& stream) {
+				const auto& oldValue = (*stream.old)[v];
+
+				auto smoothValue = ((stream.ringF * ninv) + (stream.ringE * ninv) + (n - 3.f) * oldValue) * ninv;
+				auto creaseValue = stream.sharpA * .125f + oldValue * .75f + stream.sharpB * .125f;
+
+				if (sharpCount < 2) {
+					(*stream.neu)[v] = smoothValue;
+				}
+				else if (sharpCount > 2) {
+					(*stream.neu)[v] = lerp(smoothValue, oldValue, std::min(vs, 1.f));
+				}
+				else {
+					(*stream.neu)[v] = lerp(smoothValue, creaseValue, std::min(vs, 1.f));
+				}
+				});
 			});
 
+		// --- face-varying data: seams from the value indices, then one value per new corner ---
+		[[maybe_unused]] const auto RefineFaceVarying = [&](auto& stream) {
+			if constexpr (IsFaceVarying<std::decay_t<decltype(stream)>>) {
+				using T = std::decay_t<decltype((*stream.old)[0])>;
+				const auto& values = *stream.old;
+				auto& newValues = *stream.neu;
+				newValues.assign(nC, T{});
+				stream.newSeams->assign(nF, glm::u8vec2(0, 0));
+
+				bool linear = stream.interpolation == FaceVaryingInterpolation::Linear;
+
+				const auto ValueIndex = [&](std::size_t corner) -> int {
+					return (*stream.oldIndices)[(corner < nRealCorners) ? corner : ghostCornerSources[corner - nRealCorners]];
+					};
+				const auto Value = [&](int face, int slot) -> const T& {
+					return values[ValueIndex(oldIndicesOffsets[face] + slot)];
+					};
+				const auto FacePointValue = [&](int face) -> const T& {
+					return newValues[4 * oldIndicesOffsets[face] + 2];
+					};
+
+				// child quads have the corners (vertex, next edge point, face point, previous edge point)
+				std::for_each(EXECUTION_POLICY, faceView.begin(), faceView.end(), [&](int face) {
+					int faceSize = FaceSize(face);
+					T facePoint{};
+					for (int slot = 0; slot < faceSize; ++slot) {
+						facePoint += Value(face, slot);
+					}
+					facePoint /= float(faceSize);
+					for (int slot = 0; slot < faceSize; ++slot) {
+						newValues[4 * (oldIndicesOffsets[face] + slot) + 2] = facePoint;
+					}
+					});
+
+				// the left side walks edge.x -> edge.y from its corner, the right side edge.y -> edge.x
+				std::vector<std::uint8_t> seams(oE);
+				std::for_each(EXECUTION_POLICY, edgeMap.cbegin(), edgeMap.cend(), [&](const auto& e) {
+					const auto& [edge, entry] = e;
+					const auto& [id, a, b] = entry;
+
+					int aNext = (a.corner + 1) % FaceSize(a.face);
+					int bNext = (b.corner + 1) % FaceSize(b.face);
+
+					bool seam = std::size_t(a.face) >= nRealFaces || std::size_t(b.face) >= nRealFaces
+						|| ValueIndex(oldIndicesOffsets[a.face] + a.corner) != ValueIndex(oldIndicesOffsets[b.face] + bNext)
+						|| ValueIndex(oldIndicesOffsets[a.face] + aNext) != ValueIndex(oldIndicesOffsets[b.face] + b.corner);
+					seams[id] = seam;
+
+					const auto& va = Value(a.face, a.corner);
+					const auto& vb = Value(a.face, aNext);
+					auto smooth = (va + vb + FacePointValue(a.face) + FacePointValue(b.face)) * .25f;
+					auto shared = lerp(smooth, (va + vb) * .5f, glm::min(1.f, Sharpness(edge)));
+
+					for (const auto& [side, next] : { std::pair(a, aNext), std::pair(b, bNext) }) {
+						std::size_t corner = oldIndicesOffsets[side.face] + side.corner;
+						std::size_t nextCorner = oldIndicesOffsets[side.face] + next;
+
+						T edgePoint = (seam || linear) ? lerp(Value(side.face, side.corner), Value(side.face, next), .5f) : shared;
+						newValues[4 * corner + 1] = edgePoint;
+						newValues[4 * nextCorner + 3] = edgePoint;
+
+						// the edge is the friend 1 side of the child quad of the next corner
+						(*stream.newSeams)[nextCorner] = glm::u8vec2(0, seam);
+					}
+					});
+
+				const auto NextSide = [&](int v, EdgeSide cur) -> EdgeSide {
+					int r = Index(cur.face, (cur.corner + 1) % FaceSize(cur.face));
+					const auto& [id, a, b] = edgeMap.at(UniqueEdge(v, r));
+					const auto next = (a.face == cur.face) ? b : a;
+					return { next.face, (next.corner + 1) % FaceSize(next.face) };
+					};
+
+				std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](int v) {
+					const auto start = vertexStart[v].load();
+
+					const auto ForEachCorner = [&](EdgeSide first, auto&& fn) {
+						auto cur = first;
+						do {
+							fn(cur);
+							cur = NextSide(v, cur);
+						} while (cur.face != first.face);
+						};
+
+					T E{};
+					T F{};
+					T sharpA{};
+					T sharpB{};
+
+					int   n = 0;
+					int   sharpCount = 0;
+					float sharpnessSum = 0.f;
+					int   seamCount = 0;
+					EdgeSide seamSides[2];
+
+					ForEachCorner(start, [&](EdgeSide cur) {
+						n++;
+
+						int next = (cur.corner + 1) % FaceSize(cur.face);
+						auto edge = UniqueEdge(v, Index(cur.face, next));
+
+						const auto& valueE = Value(cur.face, next);
+						E += valueE + Value(cur.face, cur.corner);
+						F += FacePointValue(cur.face);
+
+						float sharpness = Sharpness(edge);
+						sharpnessSum += sharpness;
+						if (sharpness > 0) {
+							((sharpCount == 0) ? sharpA : sharpB) = valueE;
+							++sharpCount;
+						}
+
+						if (seams[std::get<0>(edgeMap.at(edge))]) {
+							if (seamCount < 2) {
+								seamSides[seamCount] = cur;
+							}
+							++seamCount;
+						}
+						});
+
+					const auto Corner = [&](EdgeSide side) {
+						return 4 * (oldIndicesOffsets[side.face] + side.corner);
+						};
+
+					if (linear || seamCount > 2) {
+						ForEachCorner(start, [&](EdgeSide cur) { newValues[Corner(cur)] = Value(cur.face, cur.corner); });
+					}
+					else if (seamCount < 2) {
+						const auto& V = Value(start.face, start.corner);
+						float ninv = 1.f / n;
+						auto smoothRule = ((F * ninv) + (E * ninv) + (n - 3.f) * V) * ninv;
+						auto creaseRule = sharpA * .125f + V * .75f + sharpB * .125f;
+						float vs = sharpnessSum / sharpCount;
+
+						T vertexPoint = smoothRule;
+						if (sharpCount > 2) {
+							vertexPoint = lerp(smoothRule, V, std::min(vs, 1.f));
+						}
+						else if (sharpCount == 2) {
+							vertexPoint = lerp(smoothRule, creaseRule, std::min(vs, 1.f));
+						}
+						ForEachCorner(start, [&](EdgeSide cur) { newValues[Corner(cur)] = vertexPoint; });
+					}
+					else {
+						// two islands meet: crease rule along the seam with each island's own values
+						const auto IslandValue = [&](EdgeSide enter, EdgeSide exit) {
+							int faceSize = FaceSize(enter.face);
+							return Value(enter.face, (enter.corner + faceSize - 1) % faceSize) * .125f
+								+ Value(enter.face, enter.corner) * .75f
+								+ Value(exit.face, (exit.corner + 1) % FaceSize(exit.face)) * .125f;
+							};
+
+						EdgeSide enter0 = NextSide(v, seamSides[0]);
+						EdgeSide enter1 = NextSide(v, seamSides[1]);
+						T value0 = IslandValue(enter0, seamSides[1]);
+						T value1 = IslandValue(enter1, seamSides[0]);
+
+						const T* value = &value0;
+						ForEachCorner(enter0, [&](EdgeSide cur) {
+							newValues[Corner(cur)] = *value;
+							if (cur.face == seamSides[1].face) {
+								value = &value1;
+							}
+							});
+					}
+					});
+			}
+			};
+		(RefineFaceVarying(streams), ...);
+
 		return EdgefriendGeometry{
 			.positions = std::move(newPositions),
 			.indices = std::move(newIndices),
@@ -304,7 +619,49 @@ namespace Edgefriend {
 			.valenceStartInfos = std::move(newValenceStartInfos) };
 	}
 
+	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+		std::vector<glm::vec3> oldPositions,
+		std::vector<int> oldIndices,
+		std::vector<int> oldIndicesOffsets,
+		ankerl::unordered_dense::map<glm::ivec2, float> oldCreases) {
+		return SubdivideToEdgefriendGeometryImpl(std::move(oldPositions), std::move(oldIndices),
+			std::move(oldIndicesOffsets), std::move(oldCreases));
+	}
+
+	template<int N>
+	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+		std::vector<glm::vec3> oldPositions,
+		std::vector<int> oldIndices,
+		std::vector<int> oldIndicesOffsets,
+		ankerl::unordered_dense::map<glm::ivec2, float> oldCreases,
+		const std::vector<Primvar<N>>& primvars,
+		std::vector<Primvar<N>>& newPrimvars) {
+		return SubdivideToEdgefriendGeometryImpl(std::move(oldPositions), std::move(oldIndices),
+			std::move(oldIndicesOffsets), std::move(oldCreases), PrimvarStream<Primvar<N>>{ &primvars, &newPrimvars });
+	}
+
+	template<int N>
+	EdgefriendGeometry SubdivideToEdgefriendGeometry(
+		std::vector<glm::vec3> oldPositions,
+		std::vector<int> oldIndices,
+		std::vector<int> oldIndicesOffsets,
+		ankerl::unordered_dense::map<glm::ivec2, float> oldCreases,
+		const std::vector<Primvar<N>>& values,
+		const std::vector<int>& valueIndices,
+		FaceVaryingPrimvar<N>& newFaceVarying) {
+		FaceVaryingStream<Primvar<N>> stream;
+		stream.old = &values;
+		stream.oldIndices = &valueIndices;
+		stream.neu = &newFaceVarying.values;
+		stream.newSeams = &newFaceVarying.seams;
+		stream.interpolation = newFaceVarying.interpolation;
+
+		return SubdivideToEdgefriendGeometryImpl(std::move(oldPositions), std::move(oldIndices),
+			std::move(oldIndicesOffsets), std::move(oldCreases), stream);
+	}
+
 	// We tried to make it easy for you to convert this back to an hlsl shader:
+	using float2 = glm::vec2;
 	using float3 = glm::vec3;
 	using int2 = glm::ivec2;
 	using int4 = glm::ivec4;
@@ -376,27 +733,361 @@ namespace Edgefriend {
 		*reinterpret_cast<std::uint32_t*>(bytes + address + 12) = values[3];
 	}
 
+	// A buffer with the element count of a whole level that only stores the elements written so far,
+	// so the kernels can refine a few quads of a deep level with their usual global numbering.
+	// Elements are whole multiples of 16 bytes, then every Load2/Load4 of the kernels hits a single element.
+	template<typename T>
+	struct SparseBuffer {
+		ankerl::unordered_dense::map<std::uint32_t, T> elements;
+		std::size_t count = 0;
+
+		std::size_t size() const { return count; }
+		T& operator[](std::size_t i) { return elements[i]; }
+		const T& operator[](std::size_t i) const {
+			static const T empty{};
+			auto it = elements.find(i);
+			return (it != elements.end()) ? it->second : empty;
+		}
+	};
+
+	struct SparseEdgefriendGeometry {
+		SparseBuffer<glm::vec3>  positions;
+		SparseBuffer<glm::ivec4> indices; // one element per quad
+		SparseBuffer<glm::uvec4> friendsAndSharpnesses;
+		SparseBuffer<int>        valenceStartInfos;
+	};
+
+	template<typename T>
+	const std::uint32_t* LoadWords(const SparseBuffer<T>& buffer, std::uint32_t address) {
+		static_assert(sizeof(T) % 16 == 0);
+		return reinterpret_cast<const std::uint32_t*>(&buffer[address / sizeof(T)]) + address % sizeof(T) / 4;
+	}
+
+	template<typename T>
+	std::uint32_t* StoreWords(SparseBuffer<T>& buffer, std::uint32_t address) {
+		static_assert(sizeof(T) % 16 == 0);
+		return reinterpret_cast<std::uint32_t*>(&buffer[address / sizeof(T)]) + address % sizeof(T) / 4;
+	}
+
+	template<typename T>
+	glm::uint32_t Load(const SparseBuffer<T>& buffer, std::uint32_t address) {
+		return LoadWords(buffer, address)[0];
+	}
+
+	template<typename T>
+	glm::uvec2 Load2(const SparseBuffer<T>& buffer, std::uint32_t address) {
+		const std::uint32_t* words = LoadWords(buffer, address);
+		return glm::uvec2(words[0], words[1]);
+	}
+
+	template<typename T>
+	glm::uvec4 Load4(const SparseBuffer<T>& buffer, std::uint32_t address) {
+		const std::uint32_t* words = LoadWords(buffer, address);
+		return glm::uvec4(words[0], words[1], words[2], words[3]);
+	}
+
+	template<typename T>
+	void Store(SparseBuffer<T>& buffer, std::uint32_t address, const glm::uint32_t value) {
+		StoreWords(buffer, address)[0] = value;
+	}
+
+	template<typename T>
+	void Store2(SparseBuffer<T>& buffer, std::uint32_t address, const glm::uvec2& values) {
+		std::uint32_t* words = StoreWords(buffer, address);
+		words[0] = values[0];
+		words[1] = values[1];
+	}
+
+	template<typename T>
+	void Store4(SparseBuffer<T>& buffer, std::uint32_t address, const glm::uvec4& values) {
+		std::uint32_t* words = StoreWords(buffer, address);
+		for (int i = 0; i < 4; ++i) {
+			words[i] = values[i];
+		}
+	}
+
+	template<typename Geometry>
+	int NextRingCorner(const Geometry& old, int corner) {
+		int slot = corner % 4;
+		bool offId = (slot == 0) || (slot == 3);
+		return 2 * Load(old.friendsAndSharpnesses, 4 * (4 * (corner / 4) + 2 * offId)) + (corner % 2);
+	}
+
+	// --- primvar streams: same rules as the positions below, for any value type ---
+	template<typename T>
+	T VertexRule(const T& V, const T& E, const T& F, const T& sharpA, const T& sharpB,
+		int n, int sharpCount, float sharpnessSum) {
+		float beta = 3.f / (2.f * n);
+		float gamma = 1.f / (4.f * n);
+		float alpha = 1.f - beta - gamma;
+
+		float ni = 1.f / n;
+
+		T smoothRule = alpha * V + beta * E * ni + gamma * F * ni;
+		T creaseRule = sharpA * .125f + V * .75f + sharpB * .125f;
+
+		float vs = sharpnessSum / sharpCount;
+
+		if (sharpCount < 2) {
+			return smoothRule;
+		}
+		else if (sharpCount > 2) {
+			return lerp(smoothRule, V, glm::min(vs, 1.f));
+		}
+		else {
+			return lerp(smoothRule, creaseRule, glm::min(vs, 1.f));
+		}
+	}
+
+	template<typename T>
+	void Allocate(PrimvarStream<T>& stream, const EdgefriendGeometry& neu) {
+		stream.neu->resize(neu.positions.size());
+	}
+
+	template<typename T>
+	void ClearVertex(PrimvarStream<T>& stream, int offset) {
+		(*stream.neu)[offset] = T{};
+	}
+
+	template<typename T>
+	void GatherRing(PrimvarStream<T>& stream, int /*corner*/, int2 EF, bool sharp, bool first) {
+		stream.ringE += (*stream.old)[EF.x];
+		stream.ringF += (*stream.old)[EF.y];
+		if (sharp) {
+			(first ? stream.sharpA : stream.sharpB) = (*stream.old)[EF.x];
+		}
+	}
+
+	template<typename T>
+	void RefineVertex(PrimvarStream<T>& stream, const EdgefriendGeometry& /*old*/, int /*corner*/,
+		int vertex, int offset, int n, int sharpCount, float sharpnessSum) {
+		(*stream.neu)[offset] = VertexRule((*stream.old)[vertex], stream.ringE, stream.ringF,
+			stream.sharpA, stream.sharpB, n, sharpCount, sharpnessSum);
+	}
+
+	template<typename T>
+	void RefineFace(PrimvarStream<T>& stream, int /*f*/, int /*friend0*/, int /*friend1*/,
+		int4 ABCD, int4 B_C_D_A_, float sharpness0, float sharpness1,
+		int facePoint, int edgePointOff0, int edgePointOff1) {
+		const auto& in = *stream.old;
+
+		T BC = lerp(in[ABCD.y], in[ABCD.z], .5f);
+		T B_C_ = lerp(in[B_C_D_A_.x], in[B_C_D_A_.y], .5f);
+		T DA = lerp(in[ABCD.x], in[ABCD.w], .5f);
+		T D_A_ = lerp(in[B_C_D_A_.z], in[B_C_D_A_.w], .5f);
+
+		T smoothEdgePoint0 = B_C_ * .125f + BC * .75f + DA * .125f;
+		T smoothEdgePoint1 = BC * .125f + DA * .75f + D_A_ * .125f;
+
+		(*stream.neu)[facePoint] = lerp(BC, DA, .5f);
+		(*stream.neu)[edgePointOff0] = lerp(smoothEdgePoint0, BC, glm::min(1.f, sharpness0));
+		(*stream.neu)[edgePointOff1] = lerp(smoothEdgePoint1, DA, glm::min(1.f, sharpness1));
+	}
+
+	// --- face-varying streams: one value per corner, the vertex rule only sees the corners of its own UV island ---
+	template<typename T>
+	void Allocate(FaceVaryingStream<T>& stream, const EdgefriendGeometry& neu) {
+		stream.neu->resize(neu.indices.size());
+		stream.newSeams->resize(neu.friendsAndSharpnesses.size());
+	}
+
+	template<typename T>
+	void ClearVertex(FaceVaryingStream<T>& /*stream*/, int /*offset*/) {
+	}
+
+	template<typename T>
+	void GatherRing(FaceVaryingStream<T>& stream, int corner, int2 /*EF*/, bool sharp, bool first) {
+		const auto& in = *stream.old;
+		stream.ringE += in[corner ^ 3];
+		stream.ringF += in[corner ^ 2];
+		if (sharp) {
+			(first ? stream.sharpA : stream.sharpB) = in[corner ^ 3];
+		}
+
+		int slot = corner % 4;
+		bool offId = (slot == 0) || (slot == 3);
+		if ((*stream.oldSeams)[corner / 4][offId]) {
+			if (stream.seamCount < 2) {
+				stream.seamCorners[stream.seamCount] = corner;
+			}
+			++stream.seamCount;
+		}
+	}
+
+	template<typename T>
+	void RefineVertex(FaceVaryingStream<T>& stream, const EdgefriendGeometry& old, int corner,
+		int /*vertex*/, int /*offset*/, int n, int sharpCount, float sharpnessSum) {
+		if (stream.interpolation == FaceVaryingInterpolation::Linear) {
+			return; // vertex corners are copied in RefineFace
+		}
+
+		const auto& in = *stream.old;
+		auto& out = *stream.neu;
+
+		// the child quad of a corner has the same id, its corner 0 is the refined vertex
+		int corner_ = corner;
+		if (stream.seamCount > 2) {
+			do {
+				out[4 * corner_] = in[corner_];
+				corner_ = NextRingCorner(old, corner_);
+			} while (corner_ != corner);
+		}
+		else if (stream.seamCount < 2) {
+			T value = VertexRule(in[corner], stream.ringE, stream.ringF, stream.sharpA, stream.sharpB, n, sharpCount, sharpnessSum);
+			do {
+				out[4 * corner_] = value;
+				corner_ = NextRingCorner(old, corner_);
+			} while (corner_ != corner);
+		}
+		else {
+			// two islands meet: crease rule along the seam, each island with its own values.
+			// An island is entered over the on-edge (slot, slot ^ 1) and left over the off-edge (slot, slot ^ 3).
+			int exit0 = stream.seamCorners[0];
+			int exit1 = stream.seamCorners[1];
+			int enter0 = NextRingCorner(old, exit0);
+			int enter1 = NextRingCorner(old, exit1);
+
+			T value0 = in[enter0 ^ 1] * .125f + in[enter0] * .75f + in[exit1 ^ 3] * .125f;
+			T value1 = in[enter1 ^ 1] * .125f + in[enter1] * .75f + in[exit0 ^ 3] * .125f;
+
+			const T* value = &value0;
+			corner_ = enter0;
+			do {
+				out[4 * corner_] = *value;
+				if (corner_ == exit1) {
+					value = &value1;
+				}
+				corner_ = NextRingCorner(old, corner_);
+			} while (corner_ != enter0);
+		}
+	}
+
+	template<typename T>
+	void RefineFace(FaceVaryingStream<T>& stream, int f, int friend0, int friend1,
+		int4 /*ABCD*/, int4 /*B_C_D_A_*/, float sharpness0, float sharpness1,
+		int /*facePoint*/, int /*edgePointOff0*/, int /*edgePointOff1*/) {
+		const auto& in = *stream.old;
+		auto& out = *stream.neu;
+
+		// friend 0 holds C and B in its corners 2 * (friend0 & 1) + 0 and + 1, friend 1 holds A and D
+		int c0 = 4 * (friend0 / 2) + 2 * (friend0 & 1);
+		int c1 = 4 * (friend1 / 2) + 2 * (friend1 & 1);
+		int c0_ = 4 * (friend0 / 2) + 2 * ((friend0 & 1) ^ 1);
+		int c1_ = 4 * (friend1 / 2) + 2 * ((friend1 & 1) ^ 1);
+
+		T BC = lerp(in[4 * f + 1], in[4 * f + 2], .5f);
+		T DA = lerp(in[4 * f + 0], in[4 * f + 3], .5f);
+
+		// seam and linear edges keep the midpoint of each side
+		T edgePoint0 = BC;
+		T edgePoint1 = DA;
+		T friendEdgePoint0 = lerp(in[c0 + 0], in[c0 + 1], .5f);
+		T friendEdgePoint1 = lerp(in[c1 + 0], in[c1 + 1], .5f);
+
+		glm::u8vec2 seams = (*stream.oldSeams)[f];
+		bool linear = stream.interpolation == FaceVaryingInterpolation::Linear;
+
+		if (!linear && !seams[0]) {
+			T B_C_ = lerp(in[c0_ + 0], in[c0_ + 1], .5f);
+			edgePoint0 = lerp(B_C_ * .125f + BC * .75f + DA * .125f, BC, glm::min(1.f, sharpness0));
+			friendEdgePoint0 = edgePoint0;
+		}
+		if (!linear && !seams[1]) {
+			T D_A_ = lerp(in[c1_ + 0], in[c1_ + 1], .5f);
+			edgePoint1 = lerp(BC * .125f + DA * .75f + D_A_ * .125f, DA, glm::min(1.f, sharpness1));
+			friendEdgePoint1 = edgePoint1;
+		}
+
+		// corner layout of the children as in CSEdgefriend: (vertex, next edge point, face point, previous edge point)
+		T facePoint = lerp(BC, DA, .5f);
+		for (int i = 0; i < 4; ++i) {
+			out[4 * (4 * f + i) + 2] = facePoint;
+			if (linear) {
+				out[4 * (4 * f + i) + 0] = in[4 * f + i];
+			}
+		}
+
+		out[4 * (4 * f + 1) + 1] = edgePoint0;
+		out[4 * (4 * f + 2) + 3] = edgePoint0;
+		out[4 * (c0 + 0) + 1] = friendEdgePoint0;
+		out[4 * (c0 + 1) + 3] = friendEdgePoint0;
+
+		out[4 * (4 * f + 3) + 1] = edgePoint1;
+		out[4 * (4 * f + 0) + 3] = edgePoint1;
+		out[4 * (c1 + 0) + 1] = friendEdgePoint1;
+		out[4 * (c1 + 1) + 3] = friendEdgePoint1;
+
+		// seams follow the sharpnesses: children split the off-edges, the new inner edges are never seams
+		auto& newSeams = *stream.newSeams;
+		newSeams[4 * f + 0] = glm::u8vec2(0, seams[1]);
+		newSeams[4 * f + 1][0] = 0;
+		newSeams[c0 + 1][1] = seams[0];
+		newSeams[4 * f + 2] = glm::u8vec2(0, seams[0]);
+		newSeams[4 * f + 3][0] = 0;
+		newSeams[c1 + 1][1] = seams[1];
+	}
+
+	// --- bounds stream: written by the vertex threads only ---
+	void Allocate(BoundsStream& stream, const EdgefriendGeometry& neu) {
+		stream.neu->assign(neu.friendsAndSharpnesses.size(), {});
+	}
+
+	void ClearVertex(BoundsStream& /*stream*/, int /*offset*/) {
+	}
+
+	void Expand(BoundingBox& box, const float3& p) {
+		box.min = glm::min(box.min, p);
+		box.max = glm::max(box.max, p);
+	}
+
+	void GatherRing(BoundsStream& stream, int /*corner*/, int2 EF, bool /*sharp*/, bool /*first*/) {
+		Expand(stream.ring, (*stream.old)[EF.x]);
+		Expand(stream.ring, (*stream.old)[EF.y]);
+	}
+
+	void RefineVertex(BoundsStream& stream, const EdgefriendGeometry& old, int corner,
+		int vertex, int /*offset*/, int /*n*/, int /*sharpCount*/, float /*sharpnessSum*/) {
+		Expand(stream.ring, (*stream.old)[vertex]);
+		int corner_ = corner;
+		do {
+			(*stream.neu)[corner_] = stream.ring;
+			corner_ = NextRingCorner(old, corner_);
+		} while (corner_ != corner);
+	}
+
+	void RefineFace(BoundsStream& /*stream*/, int /*f*/, int /*friend0*/, int /*friend1*/,
+		int4 /*ABCD*/, int4 /*B_C_D_A_*/, float /*sharpness0*/, float /*sharpness1*/,
+		int /*facePoint*/, int /*edgePointOff0*/, int /*edgePointOff1*/) {
+	}
+
+	template<typename OldGeometry, typename NewGeometry, typename... Streams>
 	void ComputeVertexPoint(
 		int vertex,
-		const EdgefriendGeometry& old, EdgefriendGeometry& neu) {
+		const OldGeometry& old, NewGeometry& neu,
+		const PositionMask& mask, Streams... streams) {
 		int nFaces = old.friendsAndSharpnesses.size();
-		int offset = (vertex > nFaces) ? (3 * nFaces + vertex) : (4 * vertex);
+		int offset = mask.Renumber((vertex > nFaces) ? (3 * nFaces + vertex) : (4 * vertex), nFaces);
 
 		int corner = old.valenceStartInfos[vertex];
 		if (corner < 0 || corner >= nFaces * 4) { // vertex not in use
 			neu.valenceStartInfos[offset] = 0x7fffffff;
 			neu.positions[offset] = float3(0, 0, 0);
+			(ClearVertex(streams, offset), ...);
 			return;
 		}
 
 		neu.valenceStartInfos[offset] = 4 * corner;
 
+		if (!mask.Active(corner / 4)) {
+			return;
+		}
+
 		float3 V = old.positions[vertex];
 		float3 F = float3(0, 0, 0);
 		float3 E = float3(0, 0, 0);
 
-		float3 sharpA;
-		float3 sharpB;
+		float3 sharpA{};
+		float3 sharpB{};
 
 		int sharpCount = 0;
 		float sharpnessSum = 0.f;
@@ -424,6 +1115,8 @@ namespace Edgefriend {
 
 			float sharpness = asfloat(friendAndSharpness[1]);
 
+			(GatherRing(streams, 4 * quad + slot, EF, sharpness > 0, sharpCount == 0), ...);
+
 			sharpnessSum += sharpness;
 			if (sharpness > 0) {
 				if (sharpCount == 0) {
@@ -461,121 +1154,362 @@ namespace Edgefriend {
 		}
 
 		neu.positions[offset] = vertexPoint;
+
+		(RefineVertex(streams, old, corner, vertex, offset, n, sharpCount, sharpnessSum), ...);
 	}
 
-	void CSEdgefriend(uint3 dispatchThreadID, const EdgefriendGeometry& old, EdgefriendGeometry& neu) {
-		int vertex = dispatchThreadID.x;
-		if (vertex < old.positions.size()) {
-			ComputeVertexPoint(vertex, old, neu);
+	// Maps a corner up through the child frames of CSEdgefriend: child i starts at parent corner i,
+	// corners 0..3 of a quad sit at (0,0), (1,0), (1,1), (0,1).
+	SurfaceCoordinate CornerCoordinate(int corner, int level) {
+		const float2 cornerUVs[4] = { float2(0, 0), float2(1, 0), float2(1, 1), float2(0, 1) };
+
+		int quad = corner / 4;
+		float2 uv = cornerUVs[corner % 4];
+		for (int l = 0; l < level; ++l) {
+			switch (quad % 4) {
+			case 0: uv = float2(uv.x * .5f, uv.y * .5f); break;
+			case 1: uv = float2(1.f - uv.y * .5f, uv.x * .5f); break;
+			case 2: uv = float2(1.f - uv.x * .5f, 1.f - uv.y * .5f); break;
+			case 3: uv = float2(uv.y * .5f, 1.f - uv.x * .5f); break;
+			}
+			quad /= 4;
 		}
+		return { quad, uv.x, uv.y };
+	}
 
-		int f = dispatchThreadID.x;
-		int oF = old.friendsAndSharpnesses.size();
-		if (f >= oF) {
-			return;
+	SurfaceCoordinate ComputeSurfaceCoordinate(const EdgefriendGeometry& geometry, int vertex, int level) {
+		int corner = geometry.valenceStartInfos[vertex];
+		if (corner < 0 || corner >= int(geometry.indices.size())) {
+			return {};
 		}
+		return CornerCoordinate(corner, level);
+	}
 
-		/*
-		B_------B-------A-------A_
-		|       |       |       |
-		|BCB_C_ 0 ABCD  1 ADD_A_|
-		|       |       |       |
-		C_------C-------D-------D_
+	QuadAddress ComputeQuadAddress(int quad, int level) {
+		SurfaceCoordinate origin = CornerCoordinate(4 * quad, level);
 
-		Facepoint ABCD := (A + B + C + D) / 4
+		// every child frame turns by its child index, see CornerCoordinate
+		int rotation = 0;
+		for (int l = 0; l < level; ++l) {
+			rotation += (quad >> (2 * l)) & 3;
+		}
+		return { origin.baseQuad, origin.u, origin.v, std::ldexp(1.f, -level), rotation % 4 };
+	}
 
-		Edgepoint of offedge BC := (ABCD + BCB_C_ + B + C) / 4
-		Edgepoint of offedge DA := (ABCD + ADD_A_ + D + A) / 4
-		*/
+	std::vector<int> ComputeBaseQuadFaces(const std::vector<int>& indicesOffsets, int nIndices, int nBaseQuads) {
+		std::vector<int> faces(nBaseQuads, -1);
+		for (int face = 0; face < int(indicesOffsets.size()); ++face) {
+			int end = (face + 1 < int(indicesOffsets.size())) ? indicesOffsets[face + 1] : nIndices;
+			for (int corner = indicesOffsets[face]; corner < end && corner < nBaseQuads; ++corner) {
+				faces[corner] = face;
+			}
+		}
+		return faces;
+	}
 
-		uint4 friendsAndSharpness = Load4(old.friendsAndSharpnesses, 4 * 4 * f);
+	// Bilinear between texel centers, clamped to the tile. Quads without a tile (border faces) are not displaced.
+	float3 SampleDisplacement(const DisplacementMap& map, const SurfaceCoordinate& coordinate) {
+		int res = map.resolution;
+		std::size_t tileSize = std::size_t(res) * res * map.channels;
+		if (res <= 0 || coordinate.baseQuad < 0 || (coordinate.baseQuad + 1) * tileSize > map.texels.size()) {
+			return float3(0, 0, 0);
+		}
 
-		// --- load left half of quad ---
-		int friend0 = friendsAndSharpness[0];
-		float sharpness0 = asfloat(friendsAndSharpness[1]);
+		float x = glm::clamp(coordinate.u * res - .5f, 0.f, res - 1.f);
+		float y = glm::clamp(coordinate.v * res - .5f, 0.f, res - 1.f);
+		int x0 = int(x);
+		int y0 = int(y);
+		int x1 = glm::min(x0 + 1, res - 1);
+		int y1 = glm::min(y0 + 1, res - 1);
+
+		const float* tile = map.texels.data() + coordinate.baseQuad * tileSize;
+		auto Texel = [&](int tx, int ty) {
+			const float* texel = tile + (std::size_t(ty) * res + tx) * map.channels;
+			return (map.channels >= 3) ? float3(texel[0], texel[1], texel[2]) : float3(texel[0], 0, 0);
+			};
 
-		int4 indicesBCB_C_ = Load4(old.indices, 4 * 4 * (friend0 / 2));
+		float3 bottom = lerp(Texel(x0, y0), Texel(x1, y0), x - x0);
+		float3 top = lerp(Texel(x0, y1), Texel(x1, y1), x - x0);
+		return lerp(bottom, top, y - y0) * map.scale;
+	}
 
-		int iC = indicesBCB_C_[2 * (friend0 & 1) + 0];
-		int iB = indicesBCB_C_[2 * (friend0 & 1) + 1];
-		int iB_ = indicesBCB_C_[2 * ((friend0 & 1) ^ 1) + 0];
-		int iC_ = indicesBCB_C_[2 * ((friend0 & 1) ^ 1) + 1];
+	// Same ring walk as ComputeVertexPoint, but applies the Catmull-Clark limit masks
+	// instead of the refinement masks. Semi-sharp vertices blend the smooth and sharp
+	// limits with the remaining sharpness, mirroring the refinement rules.
+	// Tangents use the eigenvector masks of the smooth rule; at creases and corners the
+	// normal falls back to the fan of ring edges, the tangent to the crease direction.
+	void ComputeLimitPoint(
+		int vertex,
+		const EdgefriendGeometry& geometry, const LimitSurfaceStreams& streams) {
+		int nFaces = geometry.friendsAndSharpnesses.size();
 
-		float3 BC = lerp(old.positions[iB], old.positions[iC], .5f);
-		float3 B_C_ = lerp(old.positions[iB_], old.positions[iC_], .5f);
+		int corner = geometry.valenceStartInfos[vertex];
+		if (corner < 0 || corner >= nFaces * 4) { // vertex not in use
+			if (streams.positions) (*streams.positions)[vertex] = float3(0, 0, 0);
+			if (streams.normals) (*streams.normals)[vertex] = float3(0, 0, 0);
+			if (streams.tangents) (*streams.tangents)[vertex] = float3(0, 0, 0);
+			if (streams.coordinates) (*streams.coordinates)[vertex] = {};
+			return;
+		}
 
-		// --- load right half of quad ---
-		int friend1 = friendsAndSharpness[2];
-		float sharpness1 = asfloat(friendsAndSharpness[3]);
+		bool displaceAlongNormal = streams.displacement && streams.displacement->channels < 3;
+		bool needsFrame = streams.normals || streams.tangents || displaceAlongNormal;
 
-		int4 indicesADD_A_ = Load4(old.indices, 4 * 4 * (friend1 / 2));
+		// the tangent masks depend on the valence, so count it before the weighted walk
+		int valence = 0;
+		if (needsFrame) {
+			int corner_ = corner;
+			do {
+				++valence;
+				bool offId = ((corner_ % 4) == 0) || ((corner_ % 4) == 3);
+				corner_ = 2 * Load(geometry.friendsAndSharpnesses, 4 * (4 * (corner_ / 4) + 2 * offId)) + (corner_ % 2);
+			} while (corner_ != corner);
+		}
 
-		int iA = indicesADD_A_[2 * (friend1 & 1) + 0];
-		int iD = indicesADD_A_[2 * (friend1 & 1) + 1];
-		int iD_ = indicesADD_A_[2 * ((friend1 & 1) ^ 1) + 0];
-		int iA_ = indicesADD_A_[2 * ((friend1 & 1) ^ 1) + 1];
+		float cosStep = glm::cos(2.f * std::numbers::pi_v<float> / glm::max(valence, 1));
+		float An = 1.f + cosStep + glm::cos(std::numbers::pi_v<float> / glm::max(valence, 1)) * glm::sqrt(2.f * (9.f + cosStep));
 
-		float3 DA = lerp(old.positions[iA], old.positions[iD], .5f);
-		float3 D_A_ = lerp(old.positions[iD_], old.positions[iA_], .5f);
+		float3 V = geometry.positions[vertex];
+		float3 F = float3(0, 0, 0);
+		float3 E = float3(0, 0, 0);
 
-		// --- compute points ---
-		int facePoint = 4 * f + 1;
-		int edgePointOn0 = 4 * f + 2;
-		int edgePointOn1 = 4 * f + 3;
-		int edgePointOff0 = 4 * (friend0 / 2) + 2 + (friend0 % 2);
-		int edgePointOff1 = 4 * (friend1 / 2) + 2 + (friend1 % 2);
+		float3 T0 = float3(0, 0, 0);
+		float3 T1 = float3(0, 0, 0);
+		float3 fan = float3(0, 0, 0);
+		float3 firstE{};
+		float3 prevE{};
 
-		neu.positions[facePoint] = lerp(BC, DA, .5f);
+		float3 sharpA{};
+		float3 sharpB{};
 
-		float3 sharpEdgePoint0 = BC;
-		float3 sharpEdgePoint1 = DA;
+		int sharpCount = 0;
+		float sharpnessSum = 0.f;
 
-		float3 smoothEdgePoint0 = B_C_ * .125f + BC * .75f + DA * .125f;
-		float3 smoothEdgePoint1 = BC * .125f + DA * .75f + D_A_ * .125f;
+		int corner_ = corner;
+		int n = 0;
 
-		float3 edgePoint0 = lerp(smoothEdgePoint0, sharpEdgePoint0, glm::min(1.f, sharpness0));
-		float3 edgePoint1 = lerp(smoothEdgePoint1, sharpEdgePoint1, glm::min(1.f, sharpness1));
+		do {
+			++n;
 
-		neu.positions[edgePointOff0] = edgePoint0;
-		neu.positions[edgePointOff1] = edgePoint1;
+			int quad = corner_ / 4; // quad id
+			int slot = corner_ % 4; // slot inside quad
 
-		// --- compute quad indices ---
-		int4 quad = int4(iA, iB, iC, iD);
+			int2 EF = int2(Load(geometry.indices, 4 * (corner_ ^ 3)), Load(geometry.indices, 4 * (corner_ ^ 2)));
 
-		int4x4 quads;
-		/*
-		quad.y-----ON0-------quad.x
-		|         |         |
-		|    1    |    0    |
-		|         |         |
-		|         |         |
-		OF0--------+--------OF1
-		|         |         |
-		|    2    |    3    |
-		|         |         |
-		|         |         |
-		quad.z-----ON1-------quad.w
-		*/
+			float3 posE = geometry.positions[EF.x];
+			float3 posF = geometry.positions[EF.y];
 
-		quads[0].x = (quad.x > oF) ? (3 * oF + quad.x) : (4 * quad.x);
-		quads[0].y = edgePointOn0;
-		quads[0].z = facePoint;
-		quads[0].w = edgePointOff1;
+			E += posE;
+			F += posF;
 
-		quads[1].x = (quad.y > oF) ? (3 * oF + quad.y) : (4 * quad.y);
-		quads[1].y = edgePointOff0;
-		quads[1].z = facePoint;
-		quads[1].w = edgePointOn0;
+			if (needsFrame) {
+				// F of this step lies between the previous E and the current one
+				float theta = 2.f * std::numbers::pi_v<float> * (n - 1) / valence;
+				float thetaPrev = 2.f * std::numbers::pi_v<float> * (n - 2) / valence;
+				T0 += An * glm::cos(theta) * posE + (glm::cos(thetaPrev) + glm::cos(theta)) * posF;
+				T1 += An * glm::sin(theta) * posE + (glm::sin(thetaPrev) + glm::sin(theta)) * posF;
 
-		quads[2].x = (quad.z > oF) ? (3 * oF + quad.z) : (4 * quad.z);
-		quads[2].y = edgePointOn1;
-		quads[2].z = facePoint;
-		quads[2].w = edgePointOff0;
+				if (n == 1) {
+					firstE = posE;
+				}
+				else {
+					fan += glm::cross(prevE - V, posE - V);
+				}
+				prevE = posE;
+			}
 
-		quads[3].x = (quad.w > oF) ? (3 * oF + quad.w) : (4 * quad.w);
-		quads[3].y = edgePointOff1;
-		quads[3].z = facePoint;
-		quads[3].w = edgePointOn1;
+			bool offId = (slot == 0) || (slot == 3);
+			uint2 friendAndSharpness = Load2(geometry.friendsAndSharpnesses, 4 * (4 * quad + 2 * offId));
+
+			corner_ = 2 * friendAndSharpness[0] + (corner_ % 2);
+
+			float sharpness = asfloat(friendAndSharpness[1]);
+
+			sharpnessSum += sharpness;
+			if (sharpness > 0) {
+				if (sharpCount == 0) {
+					sharpA = posE;
+				}
+				else {
+					sharpB = posE;
+				}
+				++sharpCount;
+			}
+		} while (corner_ != corner);
+
+		float3 limitPoint;
+
+		float3 smoothLimit = (float(n * n) * V + 4.f * E + F) / float(n * (n + 5));
+		float3 creaseLimit = (sharpA + 4.f * V + sharpB) / 6.f;
+		float3 cornerLimit = V;
+
+		float vs = sharpnessSum / sharpCount;
+
+		if (sharpCount < 2) {
+			limitPoint = smoothLimit;
+		}
+		else if (sharpCount > 2) {
+			limitPoint = lerp(smoothLimit, cornerLimit, glm::min(vs, 1.f));
+		}
+		else {
+			limitPoint = lerp(smoothLimit, creaseLimit, glm::min(vs, 1.f));
+		}
+
+		float3 normal = float3(0, 0, 0);
+		if (needsFrame) {
+			fan += glm::cross(prevE - V, firstE - V);
+
+			// the walk keeps the slot parity, so starting on an odd slot circles the other way round
+			float orientation = (corner % 2) ? -1.f : 1.f;
+
+			float3 smoothNormal = orientation * glm::cross(T0, T1);
+			float3 sharpNormal = orientation * fan;
+			float3 smoothTangent = T0;
+			float3 sharpTangent = (sharpCount == 2) ? (sharpB - sharpA) : T0;
+
+			float sharpWeight = (sharpCount < 2) ? 0.f : glm::min(vs, 1.f);
+
+			auto SafeNormalize = [](float3 v) {
+				float l = glm::length(v);
+				return (l > 0.f) ? v / l : float3(0, 0, 0);
+				};
+
+			normal = SafeNormalize(lerp(SafeNormalize(smoothNormal), SafeNormalize(sharpNormal), sharpWeight));
+
+			if (streams.normals) {
+				(*streams.normals)[vertex] = normal;
+			}
+			if (streams.tangents) {
+				(*streams.tangents)[vertex] = SafeNormalize(lerp(SafeNormalize(smoothTangent), SafeNormalize(sharpTangent), sharpWeight));
+			}
+		}
+
+		if (streams.coordinates || streams.displacement) {
+			SurfaceCoordinate coordinate = CornerCoordinate(corner, streams.level);
+			if (streams.coordinates) {
+				(*streams.coordinates)[vertex] = coordinate;
+			}
+			if (streams.displacement) {
+				float3 displacement = SampleDisplacement(*streams.displacement, coordinate);
+				limitPoint += displaceAlongNormal ? displacement.x * normal : displacement;
+			}
+		}
+
+		if (streams.positions) {
+			(*streams.positions)[vertex] = limitPoint;
+		}
+	}
+
+	template<typename OldGeometry, typename NewGeometry, typename... Streams>
+	void ComputeFacePoints(int f, const OldGeometry& old, NewGeometry& neu,
+		const PositionMask& mask, Streams... streams) {
+		int oF = old.friendsAndSharpnesses.size();
+
+		/*
+		B_------B-------A-------A_
+		|       |       |       |
+		|BCB_C_ 0 ABCD  1 ADD_A_|
+		|       |       |       |
+		C_------C-------D-------D_
+
+		Facepoint ABCD := (A + B + C + D) / 4
+
+		Edgepoint of offedge BC := (ABCD + BCB_C_ + B + C) / 4
+		Edgepoint of offedge DA := (ABCD + ADD_A_ + D + A) / 4
+		*/
+
+		uint4 friendsAndSharpness = Load4(old.friendsAndSharpnesses, 4 * 4 * f);
+
+		// --- load left half of quad ---
+		int friend0 = friendsAndSharpness[0];
+		float sharpness0 = asfloat(friendsAndSharpness[1]);
+
+		int4 indicesBCB_C_ = Load4(old.indices, 4 * 4 * (friend0 / 2));
+
+		int iC = indicesBCB_C_[2 * (friend0 & 1) + 0];
+		int iB = indicesBCB_C_[2 * (friend0 & 1) + 1];
+		int iB_ = indicesBCB_C_[2 * ((friend0 & 1) ^ 1) + 0];
+		int iC_ = indicesBCB_C_[2 * ((friend0 & 1) ^ 1) + 1];
+
+		float3 BC = lerp(old.positions[iB], old.positions[iC], .5f);
+		float3 B_C_ = lerp(old.positions[iB_], old.positions[iC_], .5f);
+
+		// --- load right half of quad ---
+		int friend1 = friendsAndSharpness[2];
+		float sharpness1 = asfloat(friendsAndSharpness[3]);
+
+		int4 indicesADD_A_ = Load4(old.indices, 4 * 4 * (friend1 / 2));
+
+		int iA = indicesADD_A_[2 * (friend1 & 1) + 0];
+		int iD = indicesADD_A_[2 * (friend1 & 1) + 1];
+		int iD_ = indicesADD_A_[2 * ((friend1 & 1) ^ 1) + 0];
+		int iA_ = indicesADD_A_[2 * ((friend1 & 1) ^ 1) + 1];
+
+		float3 DA = lerp(old.positions[iA], old.positions[iD], .5f);
+		float3 D_A_ = lerp(old.positions[iD_], old.positions[iA_], .5f);
+
+		// --- compute points ---
+		int facePoint = mask.Renumber(4 * f + 1, oF);
+		int edgePointOn0 = mask.Renumber(4 * f + 2, oF);
+		int edgePointOn1 = mask.Renumber(4 * f + 3, oF);
+		int edgePointOff0 = mask.Renumber(4 * (friend0 / 2) + 2 + (friend0 % 2), oF);
+		int edgePointOff1 = mask.Renumber(4 * (friend1 / 2) + 2 + (friend1 % 2), oF);
+
+		float3 sharpEdgePoint0 = BC;
+		float3 sharpEdgePoint1 = DA;
+
+		float3 smoothEdgePoint0 = B_C_ * .125f + BC * .75f + DA * .125f;
+		float3 smoothEdgePoint1 = BC * .125f + DA * .75f + D_A_ * .125f;
+
+		float3 edgePoint0 = lerp(smoothEdgePoint0, sharpEdgePoint0, glm::min(1.f, sharpness0));
+		float3 edgePoint1 = lerp(smoothEdgePoint1, sharpEdgePoint1, glm::min(1.f, sharpness1));
+
+		if (mask.Active(f)) {
+			neu.positions[facePoint] = lerp(BC, DA, .5f);
+			neu.positions[edgePointOff0] = edgePoint0;
+			neu.positions[edgePointOff1] = edgePoint1;
+		}
+
+		(RefineFace(streams, f, friend0, friend1, int4(iA, iB, iC, iD), int4(iB_, iC_, iD_, iA_), sharpness0, sharpness1,
+			facePoint, edgePointOff0, edgePointOff1), ...);
+
+		// --- compute quad indices ---
+		int4 quad = int4(iA, iB, iC, iD);
+
+		int4x4 quads;
+		/*
+		quad.y-----ON0-------quad.x
+		|         |         |
+		|    1    |    0    |
+		|         |         |
+		|         |         |
+		OF0--------+--------OF1
+		|         |         |
+		|    2    |    3    |
+		|         |         |
+		|         |         |
+		quad.z-----ON1-------quad.w
+		*/
+
+		quads[0].x = mask.Renumber((quad.x > oF) ? (3 * oF + quad.x) : (4 * quad.x), oF);
+		quads[0].y = edgePointOn0;
+		quads[0].z = facePoint;
+		quads[0].w = edgePointOff1;
+
+		quads[1].x = mask.Renumber((quad.y > oF) ? (3 * oF + quad.y) : (4 * quad.y), oF);
+		quads[1].y = edgePointOff0;
+		quads[1].z = facePoint;
+		quads[1].w = edgePointOn0;
+
+		quads[2].x = mask.Renumber((quad.z > oF) ? (3 * oF + quad.z) : (4 * quad.z), oF);
+		quads[2].y = edgePointOn1;
+		quads[2].z = facePoint;
+		quads[2].w = edgePointOff0;
+
+		quads[3].x = mask.Renumber((quad.w > oF) ? (3 * oF + quad.w) : (4 * quad.w), oF);
+		quads[3].y = edgePointOff1;
+		quads[3].z = facePoint;
+		quads[3].w = edgePointOn1;
 
 		int faceId0 = 4 * f + 0;
 		int faceId1 = 4 * f + 1;
@@ -631,29 +1565,1642 @@ namespace Edgefriend {
 		Store2(neu.friendsAndSharpnesses, 4 * 4 * faceId3, newFriend3);
 		Store2(neu.friendsAndSharpnesses, 4 * 4 * friendFace3 + 8, newFriend3_);
 
-		neu.valenceStartInfos[4 * f + 1] = 4 * (4 * f + 0) + 2;
+		neu.valenceStartInfos[facePoint] = 4 * (4 * f + 0) + 2;
 
 		int fx = 4 * (friend0 / 2);
 		int fy = 4 * (friend1 / 2);
 		int sx = friend0 % 2;
 		int sy = friend1 % 2;
 
-		neu.valenceStartInfos[fx + 2 + sx] = 4 * (fx + 2 * sx) + 1;
-		neu.valenceStartInfos[fy + 2 + sy] = 4 * (fy + 2 * sy) + 1;
+		neu.valenceStartInfos[edgePointOff0] = 4 * (fx + 2 * sx) + 1;
+		neu.valenceStartInfos[edgePointOff1] = 4 * (fy + 2 * sy) + 1;
 	}
 
-	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old) {
+	template<typename OldGeometry, typename NewGeometry, typename... Streams>
+	void CSEdgefriend(uint3 dispatchThreadID, const OldGeometry& old, NewGeometry& neu,
+		const PositionMask& mask, Streams... streams) {
+		int vertex = dispatchThreadID.x;
+		if (vertex < old.positions.size()) {
+			ComputeVertexPoint(vertex, old, neu, mask, streams...);
+		}
+
+		int f = dispatchThreadID.x;
+		if (f < old.friendsAndSharpnesses.size()) {
+			ComputeFacePoints(f, old, neu, mask, streams...);
+		}
+	}
+
+	template<typename OldGeometry, typename NewGeometry, typename... Streams>
+	void DispatchEdgefriend(const OldGeometry& old, NewGeometry& neu, const PositionMask& mask, Streams... streams) {
+		auto threadView = std::views::iota(0, int(old.positions.size()));
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto thread) {
+			CSEdgefriend(glm::uvec3(thread, 0, 0), old, neu, mask, streams...);
+			});
+	}
+
+	template<typename OldGeometry, typename... Streams>
+	EdgefriendGeometry SubdivideEdgefriendGeometryImpl(const OldGeometry& old, const PositionMask& mask, Streams... streams) {
 		EdgefriendGeometry neu;
 		int oV = old.positions.size();
 		neu.positions.resize(oV + 3 * old.valenceStartInfos.size());
 		neu.indices.resize(old.indices.size() * 4);
 		neu.friendsAndSharpnesses.resize(old.indices.size());
 		neu.valenceStartInfos.resize(neu.positions.size());
+		(Allocate(streams, neu), ...);
 
-		auto threadView = std::views::iota(0, oV);
-		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto thread) {
-			CSEdgefriend(glm::uvec3(thread, 0, 0), old, neu);
+		DispatchEdgefriend(old, neu, mask, streams...);
+		return neu;
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old) {
+		return SubdivideEdgefriendGeometryImpl(old, PositionMask{});
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometryView& old) {
+		return SubdivideEdgefriendGeometryImpl(old, PositionMask{});
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometryPrefixStable(const EdgefriendGeometry& old) {
+		PositionMask mask;
+		mask.stableVertices = old.positions.size();
+		return SubdivideEdgefriendGeometryImpl(old, mask);
+	}
+
+	// The kernels address the bytes of a level in 32-bit ints, so the deepest level has to fit.
+	void CheckSparseLevels(const EdgefriendGeometry& base, int levels) {
+		std::uint64_t elements = std::max<std::uint64_t>(base.positions.size(), base.indices.size());
+		for (int l = 0; l < levels; ++l) {
+			elements *= 4;
+			if (4 * elements > 0x7fffffff) {
+				throw std::out_of_range("Level exceeds the 32-bit numbering of the refined mesh.");
+			}
+		}
+	}
+
+	// The kernels only index the arrays of a level, so they write straight into the slots of the pyramid.
+	struct MutableGeometryView {
+		std::span<glm::vec3>  positions;
+		std::span<int>        indices;
+		std::span<glm::uvec4> friendsAndSharpnesses;
+		std::span<int>        valenceStartInfos;
+	};
+
+	EdgefriendPyramid::EdgefriendPyramid(const EdgefriendGeometry& base, int levels) {
+		if (levels < 0) {
+			throw std::invalid_argument("Pyramid needs a non-negative level count.");
+		}
+		CheckSparseLevels(base, levels);
+
+		// every level has four times the elements of the previous one
+		offsets.resize(levels + 2);
+		for (int level = 0; level <= levels; ++level) {
+			std::size_t scale = std::size_t(1) << (2 * level);
+			LevelOffsets size{ base.positions.size() * scale, base.indices.size() * scale,
+				base.friendsAndSharpnesses.size() * scale, base.valenceStartInfos.size() * scale };
+			offsets[level + 1] = { offsets[level].positions + size.positions, offsets[level].indices + size.indices,
+				offsets[level].friendsAndSharpnesses + size.friendsAndSharpnesses, offsets[level].valenceStartInfos + size.valenceStartInfos };
+		}
+		positions.resize(offsets.back().positions);
+		indices.resize(offsets.back().indices);
+		friendsAndSharpnesses.resize(offsets.back().friendsAndSharpnesses);
+		valenceStartInfos.resize(offsets.back().valenceStartInfos);
+
+		std::copy(base.positions.begin(), base.positions.end(), positions.begin());
+		std::copy(base.indices.begin(), base.indices.end(), indices.begin());
+		std::copy(base.friendsAndSharpnesses.begin(), base.friendsAndSharpnesses.end(), friendsAndSharpnesses.begin());
+		std::copy(base.valenceStartInfos.begin(), base.valenceStartInfos.end(), valenceStartInfos.begin());
+
+		for (int level = 1; level <= levels; ++level) {
+			const LevelOffsets& begin = offsets[level];
+			const LevelOffsets& end = offsets[level + 1];
+			MutableGeometryView neu{
+				std::span(positions).subspan(begin.positions, end.positions - begin.positions),
+				std::span(indices).subspan(begin.indices, end.indices - begin.indices),
+				std::span(friendsAndSharpnesses).subspan(begin.friendsAndSharpnesses, end.friendsAndSharpnesses - begin.friendsAndSharpnesses),
+				std::span(valenceStartInfos).subspan(begin.valenceStartInfos, end.valenceStartInfos - begin.valenceStartInfos) };
+			DispatchEdgefriend(Level(level - 1), neu, PositionMask{});
+		}
+	}
+
+	EdgefriendGeometryView EdgefriendPyramid::Level(int level) const {
+		const LevelOffsets& begin = offsets.at(level);
+		const LevelOffsets& end = offsets.at(level + 1);
+		return {
+			std::span(positions).subspan(begin.positions, end.positions - begin.positions),
+			std::span(indices).subspan(begin.indices, end.indices - begin.indices),
+			std::span(friendsAndSharpnesses).subspan(begin.friendsAndSharpnesses, end.friendsAndSharpnesses - begin.friendsAndSharpnesses),
+			std::span(valenceStartInfos).subspan(begin.valenceStartInfos, end.valenceStartInfos - begin.valenceStartInfos) };
+	}
+
+	EdgefriendGeometry EdgefriendPyramid::Copy(int level) const {
+		EdgefriendGeometryView view = Level(level);
+		return {
+			{ view.positions.begin(), view.positions.end() },
+			{ view.indices.begin(), view.indices.end() },
+			{ view.friendsAndSharpnesses.begin(), view.friendsAndSharpnesses.end() },
+			{ view.valenceStartInfos.begin(), view.valenceStartInfos.end() } };
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old, PatchBounds& bounds) {
+		int nQ = 4 * old.friendsAndSharpnesses.size();
+		if (bounds.level < 1 || bounds.level > 15 || (nQ >> (2 * bounds.level) << (2 * bounds.level)) != nQ) {
+			throw std::invalid_argument("Bounds level does not match the refined mesh.");
+		}
+
+		bounds.boxes.resize(bounds.level + 1);
+		EdgefriendGeometry neu = SubdivideEdgefriendGeometryImpl(old, PositionMask{},
+			BoundsStream{ &old.positions, &bounds.boxes.back() });
+
+		// every box of a level encloses the boxes of its four children
+		for (int level = bounds.level - 1; level >= 0; --level) {
+			const std::vector<BoundingBox>& children = bounds.boxes[level + 1];
+			std::vector<BoundingBox>& boxes = bounds.boxes[level];
+			boxes.resize(children.size() / 4);
+
+			auto threadView = std::views::iota(0, int(boxes.size()));
+			std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto quad) {
+				BoundingBox box;
+				for (int i = 0; i < 4; ++i) {
+					box.min = glm::min(box.min, children[4 * quad + i].min);
+					box.max = glm::max(box.max, children[4 * quad + i].max);
+				}
+				boxes[quad] = box;
+				});
+		}
+		return neu;
+	}
+
+	std::uint64_t CombineHashes(std::uint64_t seed, std::uint64_t hash) {
+		const std::uint64_t pair[2] = { seed, hash };
+		return StableHash::Hash(pair, sizeof(pair));
+	}
+
+	void ComputeFingerprint(const EdgefriendGeometry& geometry, GeometryFingerprint& fingerprint) {
+		std::size_t nQ = geometry.friendsAndSharpnesses.size();
+		// quad ids are ints, so no level beyond 15 has a whole quad per level-0 quad
+		if (fingerprint.level < 0 || fingerprint.level > 15 || fingerprint.blockSize < 1 || !(fingerprint.tolerance > 0.f)) {
+			throw std::invalid_argument("Fingerprint settings do not match the mesh.");
+		}
+		std::size_t quadsPerBase = std::size_t(1) << (2 * fingerprint.level);
+		if (nQ % quadsPerBase != 0) {
+			throw std::invalid_argument("Fingerprint settings do not match the mesh.");
+		}
+
+		std::size_t quadsPerBlock = quadsPerBase * fingerprint.blockSize;
+		std::size_t nBlocks = (nQ + quadsPerBlock - 1) / quadsPerBlock;
+		fingerprint.blockTopology.resize(nBlocks);
+		fingerprint.blockPositions.resize(nBlocks);
+
+		double scale = 1.0 / fingerprint.tolerance;
+		auto blockView = std::views::iota(std::size_t(0), nBlocks);
+		std::for_each(EXECUTION_POLICY, blockView.begin(), blockView.end(), [&](std::size_t block) {
+			std::size_t first = block * quadsPerBlock;
+			std::size_t end = std::min(nQ, first + quadsPerBlock);
+
+			// quads of a block are contiguous, so are their indices and friends
+			fingerprint.blockTopology[block] = CombineHashes(
+				StableHash::Hash(geometry.indices.data() + 4 * first, 4 * (end - first) * sizeof(int)),
+				StableHash::Hash(geometry.friendsAndSharpnesses.data() + first, (end - first) * sizeof(glm::uvec4)));
+
+			std::uint64_t hash = 0;
+			for (std::size_t quad = first; quad < end; ++quad) {
+				std::int64_t cells[12];
+				for (int i = 0; i < 12; ++i) {
+					double cell = std::floor(geometry.positions[geometry.indices[4 * quad + i / 3]][i % 3] * scale + .5);
+					cells[i] = std::isnan(cell) ? std::numeric_limits<std::int64_t>::min() : std::int64_t(glm::clamp(cell, -9e18, 9e18));
+				}
+				hash = CombineHashes(hash, StableHash::Hash(cells, sizeof(cells)));
+			}
+			fingerprint.blockPositions[block] = hash;
 			});
+
+		fingerprint.topology = StableHash::Hash(fingerprint.blockTopology.data(), nBlocks * sizeof(std::uint64_t));
+		fingerprint.positions = StableHash::Hash(fingerprint.blockPositions.data(), nBlocks * sizeof(std::uint64_t));
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometry(const EdgefriendGeometry& old, GeometryFingerprint& fingerprint) {
+		EdgefriendGeometry neu = SubdivideEdgefriendGeometryImpl(old, PositionMask{});
+		ComputeFingerprint(neu, fingerprint);
 		return neu;
 	}
+
+	template<int N>
+	EdgefriendGeometry SubdivideEdgefriendGeometry(
+		const EdgefriendGeometry& old,
+		const std::vector<Primvar<N>>& oldPrimvars,
+		std::vector<Primvar<N>>& newPrimvars) {
+		return SubdivideEdgefriendGeometryImpl(old, PositionMask{}, PrimvarStream<Primvar<N>>{ &oldPrimvars, &newPrimvars });
+	}
+
+	template<int N>
+	EdgefriendGeometry SubdivideEdgefriendGeometry(
+		const EdgefriendGeometry& old,
+		const FaceVaryingPrimvar<N>& oldFaceVarying,
+		FaceVaryingPrimvar<N>& newFaceVarying) {
+		FaceVaryingStream<Primvar<N>> stream;
+		stream.old = &oldFaceVarying.values;
+		stream.oldSeams = &oldFaceVarying.seams;
+		stream.neu = &newFaceVarying.values;
+		stream.newSeams = &newFaceVarying.seams;
+		stream.interpolation = newFaceVarying.interpolation = oldFaceVarying.interpolation;
+
+		return SubdivideEdgefriendGeometryImpl(old, PositionMask{}, stream);
+	}
+
+	void EvaluateLimitSurface(const EdgefriendGeometry& geometry, const LimitSurfaceStreams& streams) {
+		int nV = geometry.positions.size();
+		for (auto* stream : { streams.positions, streams.normals, streams.tangents }) {
+			if (stream) {
+				stream->resize(nV);
+			}
+		}
+		if (streams.coordinates) {
+			streams.coordinates->resize(nV);
+		}
+
+		auto threadView = std::views::iota(0, nV);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto thread) {
+			ComputeLimitPoint(thread, geometry, streams);
+			});
+	}
+
+	void ProjectToLimitSurface(EdgefriendGeometry& geometry, std::vector<glm::vec3>* normals) {
+		std::vector<glm::vec3> limitPositions;
+		EvaluateLimitSurface(geometry, { .positions = &limitPositions, .normals = normals });
+		geometry.positions = std::move(limitPositions);
+	}
+
+	void DisplaceLimitSurface(EdgefriendGeometry& geometry, int level, const DisplacementMap& displacement,
+		std::vector<glm::vec3>* normals) {
+		std::vector<glm::vec3> displacedPositions;
+		EvaluateLimitSurface(geometry, { .positions = &displacedPositions, .normals = normals,
+			.displacement = &displacement, .level = level });
+		geometry.positions = std::move(displacedPositions);
+	}
+
+	EdgefriendGeometry SubdivideEdgefriendGeometryHybrid(const EdgefriendGeometry& base, int levels) {
+		if (levels <= 0) {
+			return base;
+		}
+
+		int nV = base.positions.size();
+		int nQ = base.friendsAndSharpnesses.size();
+
+		// --- classify: a quad is a uniform B-spline patch if its corners have valence 4 and no sharp edge ---
+		std::vector<std::uint8_t> regularVertices(nV);
+		auto vertexView = std::views::iota(0, nV);
+		std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](int vertex) {
+			int corner = base.valenceStartInfos[vertex];
+			if (corner < 0 || corner >= nQ * 4) {
+				return;
+			}
+
+			int n = 0;
+			bool sharp = false;
+			int corner_ = corner;
+			do {
+				++n;
+				bool offId = ((corner_ % 4) == 0) || ((corner_ % 4) == 3);
+				uint2 friendAndSharpness = Load2(base.friendsAndSharpnesses, 4 * (4 * (corner_ / 4) + 2 * offId));
+				sharp |= asfloat(friendAndSharpness[1]) > 0.f;
+				corner_ = 2 * friendAndSharpness[0] + (corner_ % 2);
+			} while (corner_ != corner && n <= 4);
+
+			regularVertices[vertex] = (n == 4) && (corner_ == corner) && !sharp;
+			});
+
+		std::vector<std::uint8_t> regularQuads(nQ);
+		auto quadView = std::views::iota(0, nQ);
+		std::for_each(EXECUTION_POLICY, quadView.begin(), quadView.end(), [&](int quad) {
+			int4 corners = Load4(base.indices, 4 * 4 * quad);
+			regularQuads[quad] = regularVertices[corners.x] && regularVertices[corners.y]
+				&& regularVertices[corners.z] && regularVertices[corners.w];
+			});
+
+		// --- the kernel refines positions of irregular quads and of every quad sharing a vertex with one.
+		// Wrong positions creep in from the edge of that region by less than one base quad over all levels ---
+		std::vector<std::uint8_t> nearIrregular(nV);
+		std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](int vertex) {
+			int corner = base.valenceStartInfos[vertex];
+			if (corner < 0 || corner >= nQ * 4) {
+				return;
+			}
+			int corner_ = corner;
+			do {
+				nearIrregular[vertex] |= !regularQuads[corner_ / 4];
+				corner_ = NextRingCorner(base, corner_);
+			} while (corner_ != corner);
+			});
+
+		std::vector<std::uint8_t> activeQuads(nQ);
+		std::for_each(EXECUTION_POLICY, quadView.begin(), quadView.end(), [&](int quad) {
+			int4 corners = Load4(base.indices, 4 * 4 * quad);
+			activeQuads[quad] = nearIrregular[corners.x] || nearIrregular[corners.y]
+				|| nearIrregular[corners.z] || nearIrregular[corners.w];
+			});
+
+		// --- 4x4 control points of every regular quad, row-major with u along corner 0 -> 1 and v along 0 -> 3.
+		// Around corner s the ring walk starts at E0 = corner s ^ 3 and ends at E3 = corner s ^ 1 ---
+		const int2 cornerCells[4] = { int2(1, 1), int2(2, 1), int2(2, 2), int2(1, 2) };
+		const int2 toE0[4] = { int2(0, 1), int2(0, 1), int2(0, -1), int2(0, -1) };
+		const int2 toE3[4] = { int2(1, 0), int2(-1, 0), int2(-1, 0), int2(1, 0) };
+
+		std::vector<std::array<int, 16>> controlPoints(nQ);
+		std::for_each(EXECUTION_POLICY, quadView.begin(), quadView.end(), [&](int quad) {
+			if (!regularQuads[quad]) {
+				return;
+			}
+			auto& cells = controlPoints[quad];
+			for (int slot = 0; slot < 4; ++slot) {
+				int2 center = cornerCells[slot];
+				int2 d0 = toE0[slot];
+				int2 d3 = toE3[slot];
+				const int2 toE[4] = { d0, -d3, -d0, d3 };
+				const int2 toF[4] = { d0 + d3, d0 - d3, -d3 - d0, d3 - d0 }; // F_i lies between E_i-1 and E_i
+
+				cells[4 * center.y + center.x] = Load(base.indices, 4 * (4 * quad + slot));
+				int corner_ = 4 * quad + slot;
+				for (int i = 0; i < 4; ++i) {
+					int2 e = center + toE[i];
+					int2 f = center + toF[i];
+					cells[4 * e.y + e.x] = Load(base.indices, 4 * (corner_ ^ 3));
+					cells[4 * f.y + f.x] = Load(base.indices, 4 * (corner_ ^ 2));
+					corner_ = NextRingCorner(base, corner_);
+				}
+			}
+			});
+
+		// --- iterate the irregular region ---
+		EdgefriendGeometry geometry = base;
+		for (int level = 0; level < levels; ++level) {
+			geometry = SubdivideEdgefriendGeometryImpl(geometry, PositionMask{ &activeQuads, level });
+		}
+
+		// --- 1D cubic B-spline refinement weights of the 2^levels + 1 points spanning a patch ---
+		std::vector<glm::vec4> weights = { glm::vec4(1, 0, 0, 0), glm::vec4(0, 1, 0, 0), glm::vec4(0, 0, 1, 0), glm::vec4(0, 0, 0, 1) };
+		for (int level = 0; level < levels; ++level) {
+			std::vector<glm::vec4> refined;
+			refined.reserve(2 * weights.size() - 3);
+			for (std::size_t i = 0; i + 1 < weights.size(); ++i) {
+				if (i > 0) {
+					refined.push_back((weights[i - 1] + 6.f * weights[i] + weights[i + 1]) * .125f);
+				}
+				refined.push_back((weights[i] + weights[i + 1]) * .5f);
+			}
+			weights = std::move(refined);
+		}
+
+		// --- separable tensor product per regular patch. The final quads of base quad b are the contiguous
+		// block b * 4^levels..., child i sits at parent corner i turned by i quarter turns (see CornerCoordinate).
+		// Each vertex is written once, from the corner its valence start points to ---
+		int size = 1 << levels;
+		int n = size + 1;
+		const int2 cornerUVs[4] = { int2(0, 0), int2(1, 0), int2(1, 1), int2(0, 1) };
+		const auto Turn = [](int2 p, int turns) {
+			switch (turns % 4) {
+			case 1: return int2(-p.y, p.x);
+			case 2: return int2(-p.x, -p.y);
+			case 3: return int2(p.y, -p.x);
+			default: return p;
+			}
+			};
+
+		std::for_each(EXECUTION_POLICY, quadView.begin(), quadView.end(), [&](int baseQuad) {
+			if (!regularQuads[baseQuad]) {
+				return;
+			}
+
+			const auto& cells = controlPoints[baseQuad];
+			std::vector<float3> rows(4 * n);
+			std::vector<float3> patch(n * n);
+			for (int row = 0; row < 4; ++row) {
+				float3 c0 = base.positions[cells[4 * row + 0]];
+				float3 c1 = base.positions[cells[4 * row + 1]];
+				float3 c2 = base.positions[cells[4 * row + 2]];
+				float3 c3 = base.positions[cells[4 * row + 3]];
+				for (int i = 0; i < n; ++i) {
+					const glm::vec4& w = weights[1 + i];
+					rows[row * n + i] = w.x * c0 + w.y * c1 + w.z * c2 + w.w * c3;
+				}
+			}
+			for (int j = 0; j < n; ++j) {
+				const glm::vec4& w = weights[1 + j];
+				for (int i = 0; i < n; ++i) {
+					patch[j * n + i] = w.x * rows[i] + w.y * rows[n + i] + w.z * rows[2 * n + i] + w.w * rows[3 * n + i];
+				}
+			}
+
+			int first = baseQuad << (2 * levels);
+			for (int local = 0; local < (1 << (2 * levels)); ++local) {
+				int2 origin = int2(0, 0);
+				int turns = 0;
+				int step = size;
+				for (int level = levels - 1; level >= 0; --level) {
+					int child = (local >> (2 * level)) & 3;
+					origin += step * Turn(cornerUVs[child], turns);
+					turns += child;
+					step /= 2;
+				}
+
+				int quad = first + local;
+				for (int slot = 0; slot < 4; ++slot) {
+					int vertex = Load(geometry.indices, 4 * (4 * quad + slot));
+					if (geometry.valenceStartInfos[vertex] == 4 * quad + slot) {
+						int2 cell = origin + step * Turn(cornerUVs[slot], turns);
+						geometry.positions[vertex] = patch[cell.y * n + cell.x];
+					}
+				}
+			}
+			});
+
+		return geometry;
+	}
+
+	// Seconds per refined quad of the last level measured by any call, the prior for the first level of the next
+	static std::atomic<double> anytimeSecondsPerQuad{ 0.0 };
+
+	// Prior before any call measured a level: one refinement of a small cube. It underestimates large meshes,
+	// which keeps the first level affordable so the first real measurement replaces it.
+	double CalibrateSecondsPerQuad() {
+		std::vector<glm::vec3> positions = {
+			{ -1, -1, -1 }, { 1, -1, -1 }, { 1, 1, -1 }, { -1, 1, -1 },
+			{ -1, -1, 1 }, { 1, -1, 1 }, { 1, 1, 1 }, { -1, 1, 1 } };
+		std::vector<int> indices = { 0, 3, 2, 1, 4, 5, 6, 7, 0, 1, 5, 4, 1, 2, 6, 5, 2, 3, 7, 6, 3, 0, 4, 7 };
+		std::vector<int> indicesOffsets = { 0, 4, 8, 12, 16, 20 };
+		EdgefriendGeometry geometry = SubdivideToEdgefriendGeometry(std::move(positions), std::move(indices), std::move(indicesOffsets), {});
+		for (int level = 0; level < 3; ++level) {
+			geometry = SubdivideEdgefriendGeometry(geometry);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		EdgefriendGeometry refined = SubdivideEdgefriendGeometry(geometry);
+		auto finish = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(finish - start).count() / refined.friendsAndSharpnesses.size();
+	}
+
+	AnytimeSubdivision SubdivideEdgefriendGeometryWithin(EdgefriendGeometry geometry, int maxLevel, std::chrono::nanoseconds budget, bool continueInBackground) {
+		using Clock = std::chrono::steady_clock;
+		auto deadline = Clock::now() + budget;
+
+		AnytimeSubdivision result;
+		double secondsPerQuad = anytimeSecondsPerQuad.load(std::memory_order_relaxed);
+		if (secondsPerQuad == 0.0) {
+			static const double calibrated = CalibrateSecondsPerQuad();
+			secondsPerQuad = calibrated;
+		}
+		while (result.level < maxLevel) {
+			// the next level costs about the quads it creates, four per current quad
+			double predicted = secondsPerQuad * 4.0 * geometry.friendsAndSharpnesses.size();
+			if (Clock::now() + std::chrono::duration<double>(predicted) > deadline) {
+				break;
+			}
+
+			auto start = Clock::now();
+			EdgefriendGeometry refined = SubdivideEdgefriendGeometry(geometry);
+			auto finish = Clock::now();
+			secondsPerQuad = std::chrono::duration<double>(finish - start).count() / std::max<std::size_t>(refined.friendsAndSharpnesses.size(), 1);
+			anytimeSecondsPerQuad.store(secondsPerQuad, std::memory_order_relaxed);
+
+			// a level that misses the deadline anyway is kept, it is the best answer there is now
+			geometry = std::move(refined);
+			++result.level;
+			if (finish > deadline) {
+				break;
+			}
+		}
+
+		if (continueInBackground && result.level < maxLevel) {
+			result.refined = std::async(std::launch::async, [coarse = geometry, levels = maxLevel - result.level]() mutable {
+				for (int i = 0; i < levels; ++i) {
+					coarse = SubdivideEdgefriendGeometry(coarse);
+				}
+				return coarse;
+				});
+		}
+		result.geometry = std::move(geometry);
+		return result;
+	}
+
+	// Inverse of the child frames of CornerCoordinate: returns the child containing uv and moves uv into its frame.
+	int ChildContaining(float2& uv) {
+		if (uv.y < .5f) {
+			if (uv.x < .5f) {
+				uv = float2(2.f * uv.x, 2.f * uv.y);
+				return 0;
+			}
+			uv = float2(2.f * uv.y, 2.f - 2.f * uv.x);
+			return 1;
+		}
+		if (uv.x >= .5f) {
+			uv = float2(2.f - 2.f * uv.x, 2.f - 2.f * uv.y);
+			return 2;
+		}
+		uv = float2(2.f - 2.f * uv.y, 2.f * uv.x);
+		return 3;
+	}
+
+	// Appends every quad sharing a vertex with quad, quad itself included.
+	template<typename Geometry>
+	void AppendOneRing(const Geometry& geometry, int quad, std::vector<int>& ring) {
+		for (int slot = 0; slot < 4; ++slot) {
+			int corner = 4 * quad + slot;
+			int corner_ = corner;
+			do {
+				ring.push_back(corner_ / 4);
+				corner_ = NextRingCorner(geometry, corner_);
+			} while (corner_ != corner);
+		}
+	}
+
+	// Refined neighbourhoods around a block of queries or faces, levels[l] holds level l + 1.
+	// A quad is complete once its indices, friends and corner positions are final. Expanding a quad runs the
+	// face and vertex kernels writing its children, which completes them and reads nothing outside its 2-ring.
+	// Expanding the 2-ring of a quad therefore needs its 4-ring complete and completes the 4-ring of each of
+	// its children, so every kernel that ran stays valid for the whole block.
+	struct SparseRefinement {
+		std::vector<SparseEdgefriendGeometry> levels;
+		std::vector<ankerl::unordered_dense::set<int>> expandedQuads;
+		std::vector<ankerl::unordered_dense::set<int>> refinedFaces;
+		std::vector<ankerl::unordered_dense::set<int>> refinedVertices;
+		std::vector<int> ring;
+		std::vector<int> twoRing;
+		std::vector<int> quadRing;
+	};
+
+	// Completes the children of quad t.
+	template<typename Geometry>
+	void ExpandQuad(const Geometry& old, SparseRefinement& refinement, int level, int t) {
+		if (!refinement.expandedQuads[level].insert(t).second) {
+			return;
+		}
+		SparseEdgefriendGeometry& neu = refinement.levels[level];
+
+		// the children of t are written by t and by the quads whose friend edge is an edge of t
+		refinement.quadRing.clear();
+		AppendOneRing(old, t, refinement.quadRing);
+		for (int r : refinement.quadRing) {
+			uint4 friends = Load4(old.friendsAndSharpnesses, 4 * 4 * r);
+			bool writesChildren = (r == t) || (int(friends[0]) / 2 == t) || (int(friends[2]) / 2 == t);
+			if (writesChildren && refinement.refinedFaces[level].insert(r).second) {
+				ComputeFacePoints(r, old, neu, PositionMask{});
+			}
+		}
+		for (int slot = 0; slot < 4; ++slot) {
+			int vertex = Load(old.indices, 4 * (4 * t + slot));
+			if (refinement.refinedVertices[level].insert(vertex).second) {
+				ComputeVertexPoint(vertex, old, neu, PositionMask{});
+			}
+		}
+	}
+
+	// Expands the 2-ring of quad.
+	template<typename Geometry>
+	void ExpandNeighbourhood(const Geometry& old, SparseRefinement& refinement, int level, int quad) {
+		refinement.ring.clear();
+		refinement.twoRing.clear();
+		AppendOneRing(old, quad, refinement.ring);
+		std::sort(refinement.ring.begin(), refinement.ring.end());
+		refinement.ring.erase(std::unique(refinement.ring.begin(), refinement.ring.end()), refinement.ring.end());
+		for (int q : refinement.ring) {
+			AppendOneRing(old, q, refinement.twoRing);
+		}
+
+		for (int t : refinement.twoRing) {
+			ExpandQuad(old, refinement, level, t);
+		}
+	}
+
+	// Calls fn with the geometry of the given level, the dense base for level 0.
+	template<typename Fn>
+	void WithSparseLevel(const EdgefriendGeometry& base, const SparseRefinement& refinement, int level, Fn&& fn) {
+		if (level == 0) {
+			fn(base);
+		}
+		else {
+			fn(refinement.levels[level - 1]);
+		}
+	}
+
+	void AllocateSparseLevels(SparseRefinement& refinement, const EdgefriendGeometry& base, int levels) {
+		refinement.levels.resize(levels);
+		refinement.expandedQuads.resize(levels);
+		refinement.refinedFaces.resize(levels);
+		refinement.refinedVertices.resize(levels);
+
+		std::size_t nV = base.positions.size();
+		std::size_t nQ = base.friendsAndSharpnesses.size();
+		for (auto& geometry : refinement.levels) {
+			nV *= 4;
+			nQ *= 4;
+			geometry.positions.count = nV;
+			geometry.indices.count = nQ;
+			geometry.friendsAndSharpnesses.count = nQ;
+			geometry.valenceStartInfos.count = nV;
+		}
+	}
+
+	std::vector<glm::vec3> SampleSubdivisionSurface(const EdgefriendGeometry& base, int level,
+		const std::vector<SurfaceCoordinate>& coordinates) {
+		int nQ = base.friendsAndSharpnesses.size();
+		CheckSparseLevels(base, level);
+
+		struct Query {
+			int quad = -1; // quad on the sample level
+			float2 uv;
+			int index = 0;
+		};
+
+		std::vector<Query> queries;
+		queries.reserve(coordinates.size());
+		for (int i = 0; i < int(coordinates.size()); ++i) {
+			const SurfaceCoordinate& coordinate = coordinates[i];
+			if (coordinate.baseQuad < 0 || coordinate.baseQuad >= nQ) {
+				continue;
+			}
+			Query query{ coordinate.baseQuad, glm::clamp(float2(coordinate.u, coordinate.v), 0.f, 1.f), i };
+			for (int l = 0; l < level; ++l) {
+				query.quad = 4 * query.quad + ChildContaining(query.uv);
+			}
+			queries.push_back(query);
+		}
+
+		// neighbouring queries share their ancestors, so a block of them shares most of its refinement
+		std::sort(queries.begin(), queries.end(), [](const Query& a, const Query& b) { return a.quad < b.quad; });
+
+		std::vector<glm::vec3> samples(coordinates.size(), glm::vec3(0));
+		constexpr int blockSize = 256;
+		int nBlocks = (int(queries.size()) + blockSize - 1) / blockSize;
+
+		auto threadView = std::views::iota(0, nBlocks);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto block) {
+			SparseRefinement refinement;
+			AllocateSparseLevels(refinement, base, level);
+
+			int end = std::min(int(queries.size()), (block + 1) * blockSize);
+			for (int i = block * blockSize; i < end; ++i) {
+				const Query& query = queries[i];
+				for (int l = 0; l < level; ++l) {
+					WithSparseLevel(base, refinement, l, [&](const auto& old) {
+						ExpandNeighbourhood(old, refinement, l, query.quad >> (2 * (level - l)));
+						});
+				}
+
+				float3 P[4];
+				WithSparseLevel(base, refinement, level, [&](const auto& geometry) {
+					for (int slot = 0; slot < 4; ++slot) {
+						P[slot] = geometry.positions[Load(geometry.indices, 4 * (4 * query.quad + slot))];
+					}
+					});
+
+				float s = query.uv.x;
+				float t = query.uv.y;
+				samples[query.index] = (1.f - s) * (1.f - t) * P[0] + s * (1.f - t) * P[1] + s * t * P[2] + (1.f - s) * t * P[3];
+			}
+			});
+
+		return samples;
+	}
+
+	std::vector<int> ComputeAdaptiveLevels(const EdgefriendGeometry& base, float tolerance, int maxLevel) {
+		// the first step moves the points of a quad off its plane by about its curvature times its squared
+		// size, every further step by a quarter of the previous one
+		EdgefriendGeometry refined = SubdivideEdgefriendGeometry(base);
+
+		int nQ = base.friendsAndSharpnesses.size();
+		std::vector<int> levels(nQ);
+
+		auto threadView = std::views::iota(0, nQ);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto quad) {
+			float3 P[4];
+			for (int slot = 0; slot < 4; ++slot) {
+				P[slot] = base.positions[base.indices[4 * quad + slot]];
+			}
+			float3 normal = glm::cross(P[2] - P[0], P[3] - P[1]);
+			float area = glm::length(normal);
+			normal = (area > 0.f) ? normal / area : float3(0, 0, 0);
+
+			float deviation = 0.f;
+			for (int corner = 16 * quad; corner < 16 * quad + 16; ++corner) {
+				SurfaceCoordinate c = CornerCoordinate(corner, 1);
+				float3 bilinear = (1.f - c.u) * (1.f - c.v) * P[0] + c.u * (1.f - c.v) * P[1] + c.u * c.v * P[2] + (1.f - c.u) * c.v * P[3];
+				deviation = glm::max(deviation, glm::abs(glm::dot(refined.positions[refined.indices[corner]] - bilinear, normal)));
+			}
+
+			int level = 0;
+			while (level < maxLevel && deviation > tolerance) {
+				deviation *= .25f;
+				++level;
+			}
+			levels[quad] = level;
+			});
+
+		return levels;
+	}
+
+	// Id of a vertex after more refinement steps, following the vertex points of ComputeVertexPoint.
+	std::uint64_t PromoteVertex(std::uint64_t vertex, std::uint64_t nQuads, int steps) {
+		for (int i = 0; i < steps; ++i) {
+			vertex = (vertex > nQuads) ? (3 * nQuads + vertex) : (4 * vertex);
+			nQuads *= 4;
+		}
+		return vertex;
+	}
+
+	// Quad on the other side of edge k, from corner k to corner k + 1.
+	template<typename Geometry>
+	int NeighbourQuad(const Geometry& geometry, int quad, int k) {
+		if (k % 2 == 1) {
+			return Load(geometry.friendsAndSharpnesses, 4 * (4 * quad + 2 * (k == 3))) / 2;
+		}
+		// the ring walk around corner k leaves over the friend edge and comes back over edge k
+		int corner = 4 * quad + k;
+		int corner_ = corner;
+		int last = quad;
+		do {
+			last = corner_ / 4;
+			corner_ = NextRingCorner(geometry, corner_);
+		} while (corner_ != corner);
+		return last;
+	}
+
+	// Corner coordinates of a quad at that level are 0, 1 or a dyadic fraction, so the border test is exact.
+	bool OnBaseQuadBorder(const SurfaceCoordinate& a, const SurfaceCoordinate& b) {
+		return (a.u == b.u && (a.u == 0.f || a.u == 1.f)) || (a.v == b.v && (a.v == 0.f || a.v == 1.f));
+	}
+
+	PolygonMesh SubdivideEdgefriendGeometryAdaptive(const EdgefriendGeometry& base, const std::vector<int>& levels) {
+		int nQ = base.friendsAndSharpnesses.size();
+		if (int(levels.size()) != nQ) {
+			throw std::invalid_argument("Expected one level per level-0 quad.");
+		}
+		if (std::ranges::any_of(levels, [](int level) { return level < 0; })) {
+			throw std::invalid_argument("Levels must not be negative.");
+		}
+		int maxLevel = levels.empty() ? 0 : std::ranges::max(levels);
+		CheckSparseLevels(base, maxLevel);
+
+		struct Vertex {
+			std::uint64_t id = 0; // promoted to maxLevel
+			int level = 0;
+			float3 position;
+		};
+
+		// the finer side of a level transition links each vertex on the shared edge to the next one in the
+		// winding of the coarser quad
+		struct Link {
+			std::uint64_t from = 0;
+			int coarseBaseQuad = 0;
+			std::uint64_t to = 0;
+		};
+
+		struct Block {
+			std::vector<std::uint64_t> corners; // 4 per output quad
+			std::vector<std::uint8_t>  borderEdges; // bit k: edge k lies on the border of the level-0 quad
+			std::vector<int>           baseQuads;
+			std::vector<Vertex>        vertices;
+			std::vector<Link>          links;
+		};
+
+		constexpr int blockSize = 64;
+		int nBlocks = (nQ + blockSize - 1) / blockSize;
+		std::vector<Block> blocks(nBlocks);
+
+		auto threadView = std::views::iota(0, nBlocks);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto blockId) {
+			Block& block = blocks[blockId];
+			SparseRefinement refinement;
+			AllocateSparseLevels(refinement, base, maxLevel);
+
+			int end = std::min(nQ, (blockId + 1) * blockSize);
+			for (int b = blockId * blockSize; b < end; ++b) {
+				int L = levels[b];
+
+				// descendants on the border of b also need their 2-ring, the inner ones have it in b already
+				for (int l = 0; l < L; ++l) {
+					WithSparseLevel(base, refinement, l, [&](const auto& old) {
+						for (int d = b << (2 * l); d < (b + 1) << (2 * l); ++d) {
+							SurfaceCoordinate c0 = CornerCoordinate(4 * d + 0, l);
+							SurfaceCoordinate c2 = CornerCoordinate(4 * d + 2, l);
+							bool border = glm::min(glm::min(c0.u, c2.u), glm::min(c0.v, c2.v)) == 0.f ||
+								glm::max(glm::max(c0.u, c2.u), glm::max(c0.v, c2.v)) == 1.f;
+							if (border) {
+								ExpandNeighbourhood(old, refinement, l, d);
+							}
+							else {
+								ExpandQuad(old, refinement, l, d);
+							}
+						}
+						});
+				}
+
+				WithSparseLevel(base, refinement, L, [&](const auto& geometry) {
+					std::uint64_t nQuads = std::uint64_t(nQ) << (2 * L);
+					for (int d = b << (2 * L); d < (b + 1) << (2 * L); ++d) {
+						std::uint64_t ids[4];
+						SurfaceCoordinate coordinates[4];
+						for (int slot = 0; slot < 4; ++slot) {
+							int vertex = Load(geometry.indices, 4 * (4 * d + slot));
+							ids[slot] = PromoteVertex(vertex, nQuads, maxLevel - L);
+							coordinates[slot] = CornerCoordinate(4 * d + slot, L);
+							block.vertices.push_back({ ids[slot], L, geometry.positions[vertex] });
+							block.corners.push_back(ids[slot]);
+						}
+
+						std::uint8_t borderEdges = 0;
+						for (int k = 0; k < 4; ++k) {
+							if (!OnBaseQuadBorder(coordinates[k], coordinates[(k + 1) % 4])) {
+								continue;
+							}
+							borderEdges |= 1 << k;
+							int neighbour = NeighbourQuad(geometry, d, k) >> (2 * L);
+							if (levels[neighbour] < L) {
+								block.links.push_back({ ids[(k + 1) % 4], neighbour, ids[k] });
+							}
+						}
+						block.borderEdges.push_back(borderEdges);
+						block.baseQuads.push_back(b);
+					}
+					});
+			}
+			});
+
+		// --- merge the blocks, shared vertices keep the position of their finest level ---
+		PolygonMesh mesh;
+		std::vector<int> vertexLevels;
+		ankerl::unordered_dense::map<std::uint64_t, int> vertexIndices;
+		ankerl::unordered_dense::map<glm::u64vec2, std::uint64_t> links;
+		for (const Block& block : blocks) {
+			for (const Vertex& vertex : block.vertices) {
+				auto [it, inserted] = vertexIndices.emplace(vertex.id, int(mesh.positions.size()));
+				if (inserted) {
+					mesh.positions.push_back(vertex.position);
+					vertexLevels.push_back(vertex.level);
+				}
+				else if (vertex.level > vertexLevels[it->second]) {
+					mesh.positions[it->second] = vertex.position;
+					vertexLevels[it->second] = vertex.level;
+				}
+			}
+			for (const Link& link : block.links) {
+				links.emplace(glm::u64vec2(link.from, link.coarseBaseQuad), link.to);
+			}
+		}
+
+		for (const Block& block : blocks) {
+			for (std::size_t quad = 0; quad < block.baseQuads.size(); ++quad) {
+				mesh.indicesOffsets.push_back(mesh.indices.size());
+				for (int k = 0; k < 4; ++k) {
+					std::uint64_t a = block.corners[4 * quad + k];
+					std::uint64_t c = block.corners[4 * quad + (k + 1) % 4];
+					mesh.indices.push_back(vertexIndices[a]);
+					if (!(block.borderEdges[quad] & (1 << k))) {
+						continue;
+					}
+					// vertices of finer neighbours along this edge
+					auto it = links.find(glm::u64vec2(a, block.baseQuads[quad]));
+					for (int n = 0; it != links.end() && it->second != c && n < (1 << maxLevel); ++n) {
+						mesh.indices.push_back(vertexIndices[it->second]);
+						it = links.find(glm::u64vec2(it->second, block.baseQuads[quad]));
+					}
+				}
+			}
+		}
+
+		return mesh;
+	}
+
+	// Lock-free union-find: roots only ever link to smaller roots, so concurrent unions cannot form cycles.
+	int FindRoot(std::vector<std::atomic<int>>& parents, int v) {
+		while (true) {
+			int parent = parents[v].load(std::memory_order_relaxed);
+			if (parent == v) {
+				return v;
+			}
+			int grandparent = parents[parent].load(std::memory_order_relaxed);
+			parents[v].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+			v = grandparent;
+		}
+	}
+
+	void Unite(std::vector<std::atomic<int>>& parents, int a, int b) {
+		while (true) {
+			a = FindRoot(parents, a);
+			b = FindRoot(parents, b);
+			if (a == b) {
+				return;
+			}
+			if (a < b) {
+				std::swap(a, b);
+			}
+			int expected = a;
+			if (parents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+				return;
+			}
+		}
+	}
+
+	MeshComponents FindConnectedComponents(const std::vector<int>& indices, const std::vector<int>& indicesOffsets,
+		std::size_t vertexCount) {
+		const int nF = indicesOffsets.size();
+		const auto FaceEnd = [&](int face) {
+			return (face + 1 < nF) ? indicesOffsets[face + 1] : int(indices.size());
+			};
+
+		std::vector<std::atomic<int>> parents(vertexCount);
+		auto vertexView = std::views::iota(std::size_t(0), vertexCount);
+		std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](std::size_t v) {
+			parents[v].store(int(v), std::memory_order_relaxed);
+			});
+
+		auto faceView = std::views::iota(0, nF);
+		std::for_each(EXECUTION_POLICY, faceView.begin(), faceView.end(), [&](int face) {
+			for (int i = indicesOffsets[face] + 1; i < FaceEnd(face); ++i) {
+				Unite(parents, indices[indicesOffsets[face]], indices[i]);
+			}
+			});
+
+		MeshComponents components;
+		components.faceComponents.resize(nF);
+		std::for_each(EXECUTION_POLICY, faceView.begin(), faceView.end(), [&](int face) {
+			components.faceComponents[face] = (indicesOffsets[face] < FaceEnd(face)) ? FindRoot(parents, indices[indicesOffsets[face]]) : -1;
+			});
+
+		// roots to dense ids in the order of the first face
+		ankerl::unordered_dense::map<int, int> ids;
+		for (int& component : components.faceComponents) {
+			if (component >= 0) {
+				component = ids.emplace(component, int(ids.size())).first->second;
+			}
+		}
+		components.count = ids.size();
+		return components;
+	}
+
+	std::vector<EdgefriendGeometry> SubdivideFaceGroups(
+		const PolygonMesh& mesh,
+		const ankerl::unordered_dense::map<glm::ivec2, float>& sharpEdges,
+		const std::vector<int>& faceGroups, int groupCount, int levels) {
+		const int nF = mesh.indicesOffsets.size();
+		const auto FaceEnd = [&](int face) {
+			return (face + 1 < nF) ? mesh.indicesOffsets[face + 1] : int(mesh.indices.size());
+			};
+
+		// faces of every group in input order
+		std::vector<int> groupStarts(groupCount + 1, 0);
+		for (int face = 0; face < nF; ++face) {
+			if (faceGroups[face] >= 0) {
+				++groupStarts[faceGroups[face] + 1];
+			}
+		}
+		std::partial_sum(groupStarts.begin(), groupStarts.end(), groupStarts.begin());
+		std::vector<int> groupFaces(groupStarts.back());
+		std::vector<int> cursors(groupStarts.begin(), groupStarts.end() - 1);
+		for (int face = 0; face < nF; ++face) {
+			if (faceGroups[face] >= 0) {
+				groupFaces[cursors[faceGroups[face]]++] = face;
+			}
+		}
+
+		std::vector<EdgefriendGeometry> results(groupCount);
+		auto groupView = std::views::iota(0, groupCount);
+		std::for_each(EXECUTION_POLICY, groupView.begin(), groupView.end(), [&](int group) {
+			std::span<const int> faces(groupFaces.data() + groupStarts[group], groupStarts[group + 1] - groupStarts[group]);
+
+			std::vector<int> vertices;
+			for (int face : faces) {
+				vertices.insert(vertices.end(), mesh.indices.begin() + mesh.indicesOffsets[face], mesh.indices.begin() + FaceEnd(face));
+			}
+			std::sort(vertices.begin(), vertices.end());
+			vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+			const auto Local = [&](int v) {
+				return int(std::lower_bound(vertices.begin(), vertices.end(), v) - vertices.begin());
+				};
+
+			std::vector<glm::vec3> positions(vertices.size());
+			for (std::size_t i = 0; i < vertices.size(); ++i) {
+				positions[i] = mesh.positions[vertices[i]];
+			}
+
+			std::vector<int> indices;
+			std::vector<int> indicesOffsets;
+			ankerl::unordered_dense::map<glm::ivec2, float> creases;
+			for (int face : faces) {
+				indicesOffsets.push_back(indices.size());
+				for (int i = mesh.indicesOffsets[face]; i < FaceEnd(face); ++i) {
+					indices.push_back(Local(mesh.indices[i]));
+
+					int next = (i + 1 < FaceEnd(face)) ? i + 1 : mesh.indicesOffsets[face];
+					auto [a, b] = std::minmax(mesh.indices[i], mesh.indices[next]);
+					auto crease = sharpEdges.find(glm::ivec2(a, b));
+					if (crease != sharpEdges.end()) {
+						creases.emplace(glm::ivec2(Local(a), Local(b)), crease->second);
+					}
+				}
+			}
+
+			EdgefriendGeometry geometry = SubdivideToEdgefriendGeometry(
+				std::move(positions), std::move(indices), std::move(indicesOffsets), std::move(creases));
+			for (int level = 0; level < levels; ++level) {
+				geometry = SubdivideEdgefriendGeometry(geometry);
+			}
+			results[group] = std::move(geometry);
+			});
+		return results;
+	}
+
+	EdgefriendGeometry MergeEdgefriendGeometries(const std::vector<EdgefriendGeometry>& parts) {
+		std::vector<std::size_t> vertexOffsets(parts.size() + 1, 0);
+		std::vector<std::size_t> quadOffsets(parts.size() + 1, 0);
+		for (std::size_t i = 0; i < parts.size(); ++i) {
+			vertexOffsets[i + 1] = vertexOffsets[i] + parts[i].positions.size();
+			quadOffsets[i + 1] = quadOffsets[i] + parts[i].friendsAndSharpnesses.size();
+		}
+		if (4 * quadOffsets.back() > std::size_t(std::numeric_limits<int>::max()) ||
+			vertexOffsets.back() > std::size_t(std::numeric_limits<int>::max())) {
+			throw std::out_of_range("Merged geometry does not fit the 32-bit numbering.");
+		}
+
+		EdgefriendGeometry merged;
+		merged.positions.resize(vertexOffsets.back());
+		merged.indices.resize(4 * quadOffsets.back());
+		merged.friendsAndSharpnesses.resize(quadOffsets.back());
+		merged.valenceStartInfos.resize(vertexOffsets.back());
+
+		auto partView = std::views::iota(std::size_t(0), parts.size());
+		std::for_each(EXECUTION_POLICY, partView.begin(), partView.end(), [&](std::size_t i) {
+			const EdgefriendGeometry& part = parts[i];
+			int vertexOffset = vertexOffsets[i];
+			int quadOffset = quadOffsets[i];
+			int nCorners = 4 * part.friendsAndSharpnesses.size();
+
+			std::copy(part.positions.begin(), part.positions.end(), merged.positions.begin() + vertexOffset);
+			std::transform(part.indices.begin(), part.indices.end(), merged.indices.begin() + 4 * quadOffset,
+				[&](int vertex) { return vertex + vertexOffset; });
+			// friends are 2 * quad + side, sharpnesses stay
+			std::transform(part.friendsAndSharpnesses.begin(), part.friendsAndSharpnesses.end(), merged.friendsAndSharpnesses.begin() + quadOffset,
+				[&](glm::uvec4 friends) { return friends + glm::uvec4(2 * quadOffset, 0, 2 * quadOffset, 0); });
+			// unused slots keep their marker
+			std::transform(part.valenceStartInfos.begin(), part.valenceStartInfos.end(), merged.valenceStartInfos.begin() + vertexOffset,
+				[&](int corner) { return (corner >= 0 && corner < nCorners) ? corner + 4 * quadOffset : corner; });
+			});
+		return merged;
+	}
+
+	EdgefriendGeometry SubdivideByComponents(
+		const PolygonMesh& mesh,
+		const ankerl::unordered_dense::map<glm::ivec2, float>& sharpEdges,
+		int levels) {
+		MeshComponents components = FindConnectedComponents(mesh.indices, mesh.indicesOffsets, mesh.positions.size());
+		return MergeEdgefriendGeometries(SubdivideFaceGroups(mesh, sharpEdges, components.faceComponents, components.count, levels));
+	}
+
+	// Cone of the triangle normals as in meshoptimizer: the axis averages the unit normals, the apex is
+	// the point on the axis behind every triangle plane. Clusters whose normals spread too far get cutoff 1.
+	void ComputeMeshletBounds(Meshlet& meshlet, const EdgefriendGeometry& geometry,
+		const std::vector<std::uint32_t>& vertices, const std::vector<std::uint8_t>& triangles) {
+		auto Position = [&](int local) { return geometry.positions[vertices[meshlet.vertexOffset + local]]; };
+
+		BoundingBox box;
+		for (std::uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			box.min = glm::min(box.min, Position(i));
+			box.max = glm::max(box.max, Position(i));
+		}
+		meshlet.center = (box.min + box.max) * .5f;
+		meshlet.radius = 0.f;
+		for (std::uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+			meshlet.radius = glm::max(meshlet.radius, glm::length(Position(i) - meshlet.center));
+		}
+
+		std::array<float3, 126> normals;
+		std::array<float3, 126> origins;
+		float3 axis(0.f);
+		for (std::uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+			const std::uint8_t* tri = &triangles[meshlet.triangleOffset + 3 * t];
+			float3 p0 = Position(tri[0]);
+			float3 n = glm::cross(Position(tri[1]) - p0, Position(tri[2]) - p0);
+			float area = glm::length(n);
+			normals[t] = (area > 0.f) ? n / area : float3(0.f);
+			origins[t] = p0;
+			axis += normals[t];
+		}
+
+		float axisLength = glm::length(axis);
+		meshlet.coneAxis = (axisLength > 0.f) ? axis / axisLength : float3(0.f);
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneCutoff = 1.f;
+
+		float minDot = 1.f;
+		for (std::uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+			minDot = glm::min(minDot, glm::dot(normals[t], meshlet.coneAxis));
+		}
+		if (axisLength == 0.f || minDot <= .1f) {
+			return;
+		}
+
+		float maxT = 0.f;
+		for (std::uint32_t t = 0; t < meshlet.triangleCount; ++t) {
+			float dc = glm::dot(meshlet.center - origins[t], normals[t]);
+			float dn = glm::dot(meshlet.coneAxis, normals[t]);
+			maxT = glm::max(maxT, dc / dn);
+		}
+		meshlet.coneApex = meshlet.center - meshlet.coneAxis * maxT;
+		meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+	}
+
+	MeshletMesh BuildMeshlets(const EdgefriendGeometry& geometry) {
+		constexpr int maxVertices = 64;
+		constexpr int maxTriangles = 126;
+		constexpr int chunkSize = 4096; // quads, a few whole quadtrees of the upper levels
+
+		struct Chunk {
+			std::vector<Meshlet>       meshlets;
+			std::vector<std::uint32_t> vertices;
+			std::vector<std::uint8_t>  triangles;
+		};
+
+		int nQ = geometry.friendsAndSharpnesses.size();
+		int nChunks = (nQ + chunkSize - 1) / chunkSize;
+		std::vector<Chunk> chunks(nChunks);
+
+		// quads of one parent are consecutive, so a greedy scan in quad order fills meshlets with whole quadtrees
+		auto threadView = std::views::iota(0, nChunks);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto chunkId) {
+			Chunk& chunk = chunks[chunkId];
+			Meshlet meshlet;
+
+			auto Flush = [&]() {
+				if (meshlet.triangleCount > 0) {
+					ComputeMeshletBounds(meshlet, geometry, chunk.vertices, chunk.triangles);
+					chunk.meshlets.push_back(meshlet);
+				}
+				meshlet = Meshlet{};
+				meshlet.vertexOffset = chunk.vertices.size();
+				meshlet.triangleOffset = chunk.triangles.size();
+			};
+			Flush();
+
+			int end = std::min(nQ, (chunkId + 1) * chunkSize);
+			for (int quad = chunkId * chunkSize; quad < end; ++quad) {
+				int4 corners = Load4(geometry.indices, 4 * 4 * quad);
+
+				auto LocalIndex = [&](int vertex) -> int {
+					auto first = chunk.vertices.begin() + meshlet.vertexOffset;
+					auto it = std::find(first, chunk.vertices.end(), std::uint32_t(vertex));
+					return (it != chunk.vertices.end()) ? int(it - first) : -1;
+				};
+
+				int newVertices = 0;
+				for (int slot = 0; slot < 4; ++slot) {
+					newVertices += (LocalIndex(corners[slot]) < 0);
+				}
+				if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 2 > maxTriangles) {
+					Flush();
+				}
+
+				std::uint8_t local[4];
+				for (int slot = 0; slot < 4; ++slot) {
+					int index = LocalIndex(corners[slot]);
+					if (index < 0) {
+						index = meshlet.vertexCount++;
+						chunk.vertices.push_back(corners[slot]);
+					}
+					local[slot] = index;
+				}
+				for (std::uint8_t index : { local[0], local[1], local[2], local[0], local[2], local[3] }) {
+					chunk.triangles.push_back(index);
+				}
+				meshlet.triangleCount += 2;
+			}
+			Flush();
+			});
+
+		MeshletMesh result;
+		for (Chunk& chunk : chunks) {
+			for (Meshlet meshlet : chunk.meshlets) {
+				meshlet.vertexOffset += result.vertices.size();
+				meshlet.triangleOffset += result.triangles.size();
+				result.meshlets.push_back(meshlet);
+			}
+			result.vertices.insert(result.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+			result.triangles.insert(result.triangles.end(), chunk.triangles.begin(), chunk.triangles.end());
+		}
+		return result;
+	}
+
+	// Cell of step d along the Hilbert curve through an n x n grid, n a power of two. Starts at (0, 0), ends at (n - 1, 0).
+	int2 HilbertCell(int n, int d) {
+		int2 cell(0, 0);
+		for (int s = 1; s < n; s *= 2) {
+			int rx = 1 & (d / 2);
+			int ry = 1 & (d ^ rx);
+			if (ry == 0) {
+				if (rx == 1) {
+					cell = int2(s - 1) - cell;
+				}
+				std::swap(cell.x, cell.y);
+			}
+			cell += s * int2(rx, ry);
+			d /= 4;
+		}
+		return cell;
+	}
+
+	std::vector<std::uint32_t> ExportTriangles(const EdgefriendGeometry& geometry, int level) {
+		int nQ = geometry.friendsAndSharpnesses.size();
+		// quad ids are ints, so no level beyond 15 has a whole quad per base quad
+		if (level < 0 || level > 15) {
+			throw std::invalid_argument("Level does not match the quad count of the geometry.");
+		}
+		int nBase = nQ >> (2 * level);
+		if ((nBase << (2 * level)) != nQ) {
+			throw std::invalid_argument("Level does not match the quad count of the geometry.");
+		}
+
+		std::vector<std::uint32_t> triangles(6 * std::size_t(nQ));
+		int n = 1 << level;
+
+		auto threadView = std::views::iota(0, nBase);
+		std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto baseQuad) {
+			int first = baseQuad << (2 * level);
+			for (int d = 0; d < n * n; ++d) {
+				// descend to the quad covering the cell, the child frames turn so the quad order alone is no curve
+				int2 cell = HilbertCell(n, d);
+				float2 uv = (float2(cell) + .5f) / float(n);
+				int quad = baseQuad;
+				for (int l = 0; l < level; ++l) {
+					quad = 4 * quad + ChildContaining(uv);
+				}
+
+				int4 corners = Load4(geometry.indices, 4 * 4 * quad);
+				std::uint32_t* out = &triangles[6 * std::size_t(first + d)];
+				for (int index : { corners[0], corners[1], corners[2], corners[0], corners[2], corners[3] }) {
+					*out++ = index;
+				}
+			}
+			});
+		return triangles;
+	}
+
+	VertexCacheStatistics AnalyzeVertexCache(const std::vector<std::uint32_t>& triangles, std::size_t vertexCount,
+		int cacheSize) {
+		// FIFO cache of post-transform vertices, stamped with the miss count at which they entered
+		std::vector<std::size_t> entered(vertexCount, 0);
+		std::size_t misses = 0;
+		for (std::uint32_t vertex : triangles) {
+			if (entered[vertex] == 0 || misses - entered[vertex] + 1 > std::size_t(cacheSize)) {
+				++misses;
+				entered[vertex] = misses;
+			}
+		}
+
+		VertexCacheStatistics statistics;
+		statistics.transformedVertices = misses;
+		if (!triangles.empty()) {
+			statistics.acmr = float(misses) / float(triangles.size() / 3);
+		}
+		std::size_t usedVertices = std::ranges::count_if(entered, [](std::size_t stamp) { return stamp > 0; });
+		if (usedVertices > 0) {
+			statistics.atvr = float(misses) / float(usedVertices);
+		}
+		return statistics;
+	}
+
+	// --- detail pyramid codec ---
+	struct BitWriter {
+		std::vector<std::uint8_t>& bytes;
+		std::uint64_t buffer = 0;
+		int bits = 0;
+
+		void Write(std::uint32_t value, int count) {
+			for (int i = 0; i < count; ++i) {
+				buffer |= std::uint64_t((value >> i) & 1) << bits;
+				if (++bits == 64) {
+					Flush();
+				}
+			}
+		}
+
+		void Flush() {
+			for (int i = 0; i < bits; i += 8) {
+				bytes.push_back(std::uint8_t(buffer >> i));
+			}
+			buffer = 0;
+			bits = 0;
+		}
+	};
+
+	struct BitReader {
+		const std::uint8_t* bytes = nullptr;
+		std::size_t size = 0;
+		std::size_t bit = 0;
+
+		std::uint32_t Read(int count) {
+			std::uint32_t value = 0;
+			for (int i = 0; i < count; ++i, ++bit) {
+				if (bit / 8 >= size) {
+					throw std::runtime_error("Detail pyramid is truncated.");
+				}
+				value |= std::uint32_t((bytes[bit / 8] >> (bit % 8)) & 1) << i;
+			}
+			return value;
+		}
+	};
+
+	constexpr std::uint32_t riceEscape = 32;
+	constexpr int riceBlockSize = 256;
+
+	// Quotient in unary, remainder in k bits; quotients from riceEscape on store the value raw.
+	void WriteRice(BitWriter& writer, std::uint32_t value, int k) {
+		std::uint32_t quotient = value >> k;
+		if (quotient >= riceEscape) {
+			writer.Write(0xffffffff, riceEscape);
+			writer.Write(value, 32);
+			return;
+		}
+		writer.Write(0xffffffff, quotient);
+		writer.Write(0, 1);
+		writer.Write(value, k);
+	}
+
+	std::uint32_t ReadRice(BitReader& reader, int k) {
+		std::uint32_t quotient = 0;
+		while (quotient < riceEscape && reader.Read(1)) {
+			++quotient;
+		}
+		if (quotient == riceEscape) {
+			return reader.Read(32);
+		}
+		return (quotient << k) | reader.Read(k);
+	}
+
+	// Each block of residuals picks the Rice parameter of its mean.
+	void WriteResiduals(std::vector<std::uint8_t>& bytes, const std::vector<std::uint32_t>& values) {
+		BitWriter writer{ bytes };
+		for (std::size_t first = 0; first < values.size(); first += riceBlockSize) {
+			std::size_t end = std::min(values.size(), first + riceBlockSize);
+			std::uint64_t sum = 0;
+			for (std::size_t i = first; i < end; ++i) {
+				sum += values[i];
+			}
+			std::uint64_t mean = sum / (end - first);
+			int k = 0;
+			while (k < 31 && (std::uint64_t(1) << (k + 1)) <= mean) {
+				++k;
+			}
+			writer.Write(k, 5);
+			for (std::size_t i = first; i < end; ++i) {
+				WriteRice(writer, values[i], k);
+			}
+		}
+		writer.Flush();
+	}
+
+	std::vector<std::uint32_t> ReadResiduals(BitReader& reader, std::size_t count) {
+		std::vector<std::uint32_t> values(count);
+		for (std::size_t first = 0; first < count; first += riceBlockSize) {
+			std::size_t end = std::min(count, first + riceBlockSize);
+			int k = reader.Read(5);
+			for (std::size_t i = first; i < end; ++i) {
+				values[i] = ReadRice(reader, k);
+			}
+		}
+		return values;
+	}
+
+	std::uint32_t ZigZag(std::int32_t value) {
+		return (std::uint32_t(value) << 1) ^ std::uint32_t(value >> 31);
+	}
+
+	std::int32_t UnZigZag(std::uint32_t value) {
+		return std::int32_t(value >> 1) ^ -std::int32_t(value & 1);
+	}
+
+	template<typename T>
+	void WriteArray(std::vector<std::uint8_t>& bytes, const std::vector<T>& values) {
+		std::uint64_t count = values.size();
+		auto countBytes = reinterpret_cast<const std::uint8_t*>(&count);
+		bytes.insert(bytes.end(), countBytes, countBytes + sizeof(count));
+		auto valueBytes = reinterpret_cast<const std::uint8_t*>(values.data());
+		bytes.insert(bytes.end(), valueBytes, valueBytes + values.size() * sizeof(T));
+	}
+
+	template<typename T>
+	void ReadArray(BitReader& reader, std::vector<T>& values) {
+		std::uint64_t count = reader.Read(32);
+		count |= std::uint64_t(reader.Read(32)) << 32;
+		if (count > (reader.size - reader.bit / 8) / sizeof(T)) {
+			throw std::runtime_error("Detail pyramid is truncated.");
+		}
+		values.resize(count);
+		std::memcpy(values.data(), reader.bytes + reader.bit / 8, count * sizeof(T));
+		reader.bit += 8 * count * sizeof(T);
+	}
+
+	constexpr std::uint32_t detailPyramidMagic = 0x50444645; // "EFDP"
+
+	std::vector<std::uint8_t> EncodeDetailPyramid(const std::vector<EdgefriendGeometry>& levels, float step) {
+		if (levels.empty() || !(step > 0.f)) {
+			throw std::invalid_argument("Detail pyramid needs at least one level and a positive step.");
+		}
+
+		std::vector<std::uint8_t> bytes;
+		std::uint32_t header[3] = { detailPyramidMagic, std::uint32_t(levels.size()), asuint(step) };
+		bytes.insert(bytes.end(), reinterpret_cast<std::uint8_t*>(header), reinterpret_cast<std::uint8_t*>(header + 3));
+
+		const EdgefriendGeometry& base = levels.front();
+		WriteArray(bytes, base.positions);
+		WriteArray(bytes, base.indices);
+		WriteArray(bytes, base.friendsAndSharpnesses);
+		WriteArray(bytes, base.valenceStartInfos);
+
+		// predict from the reconstruction the decoder will have, so quantization errors do not pile up
+		EdgefriendGeometry reconstructed = base;
+		for (std::size_t level = 1; level < levels.size(); ++level) {
+			EdgefriendGeometry predicted = SubdivideEdgefriendGeometry(reconstructed);
+			const std::vector<glm::vec3>& actual = levels[level].positions;
+			if (actual.size() != predicted.positions.size()) {
+				throw std::invalid_argument("Every level of a detail pyramid has to refine the previous one.");
+			}
+
+			// one plane per coordinate
+			std::size_t nV = actual.size();
+			std::vector<std::uint32_t> residuals(3 * nV);
+			auto threadView = std::views::iota(std::size_t(0), nV);
+			std::for_each(EXECUTION_POLICY, threadView.begin(), threadView.end(), [&](auto vertex) {
+				for (int i = 0; i < 3; ++i) {
+					float residual = std::round((actual[vertex][i] - predicted.positions[vertex][i]) / step);
+					std::int32_t q = std::int32_t(glm::clamp(residual, -1e9f, 1e9f));
+					residuals[i * nV + vertex] = ZigZag(q);
+					predicted.positions[vertex][i] += float(q) * step;
+				}
+				});
+
+			std::vector<std::uint8_t> levelBytes;
+			WriteResiduals(levelBytes, residuals);
+			std::uint64_t levelSize = levelBytes.size();
+			bytes.insert(bytes.end(), reinterpret_cast<std::uint8_t*>(&levelSize), reinterpret_cast<std::uint8_t*>(&levelSize + 1));
+			bytes.insert(bytes.end(), levelBytes.begin(), levelBytes.end());
+
+			reconstructed = std::move(predicted);
+		}
+		return bytes;
+	}
+
+	EdgefriendGeometry DecodeDetailPyramid(const std::vector<std::uint8_t>& bytes, int level) {
+		BitReader reader{ bytes.data(), bytes.size() };
+		if (reader.Read(32) != detailPyramidMagic) {
+			throw std::runtime_error("Not a detail pyramid.");
+		}
+		int nLevels = reader.Read(32);
+		float step = asfloat(reader.Read(32));
+		if (level >= nLevels) {
+			throw std::out_of_range("Detail pyramid does not hold the requested level.");
+		}
+		if (level < 0) {
+			level = nLevels - 1;
+		}
+
+		EdgefriendGeometry geometry;
+		ReadArray(reader, geometry.positions);
+		ReadArray(reader, geometry.indices);
+		ReadArray(reader, geometry.friendsAndSharpnesses);
+		ReadArray(reader, geometry.valenceStartInfos);
+
+		for (int l = 1; l <= level; ++l) {
+			std::uint64_t levelSize = reader.Read(32);
+			levelSize |= std::uint64_t(reader.Read(32)) << 32;
+			std::size_t levelEnd = reader.bit / 8 + levelSize;
+
+			geometry = SubdivideEdgefriendGeometry(geometry);
+			std::size_t nV = geometry.positions.size();
+			std::vector<std::uint32_t> residuals = ReadResiduals(reader, 3 * nV);
+			for (std::size_t vertex = 0; vertex < nV; ++vertex) {
+				for (int i = 0; i < 3; ++i) {
+					geometry.positions[vertex][i] += float(UnZigZag(residuals[i * nV + vertex])) * step;
+				}
+			}
+			reader.bit = 8 * levelEnd;
+		}
+		return geometry;
+	}
+
+	// Distance in representable floats, with -0 and +0 one apart from their neighbours alike.
+	std::uint32_t UlpDistance(float a, float b) {
+		const auto Ordered = [](float value) {
+			std::int64_t bits = std::int32_t(asuint(value));
+			return (bits < 0) ? std::int64_t(std::numeric_limits<std::int32_t>::min()) - bits : bits;
+			};
+		return std::uint32_t(std::min<std::int64_t>(std::abs(Ordered(a) - Ordered(b)), std::numeric_limits<std::uint32_t>::max()));
+	}
+
+	template<typename T>
+	std::size_t CountMismatches(const std::vector<T>& a, const std::vector<T>& b) {
+		std::size_t n = std::min(a.size(), b.size());
+		return std::transform_reduce(EXECUTION_POLICY, a.begin(), a.begin() + n, b.begin(), std::size_t(0),
+			std::plus<>(), [](const T& x, const T& y) { return std::size_t(x != y); });
+	}
+
+	GeometryDifference CompareGeometry(const EdgefriendGeometry& a, const EdgefriendGeometry& b, float positionEpsilon, int worstCount) {
+		GeometryDifference difference;
+		difference.sizesMatch = a.positions.size() == b.positions.size() && a.indices.size() == b.indices.size() &&
+			a.friendsAndSharpnesses.size() == b.friendsAndSharpnesses.size() && a.valenceStartInfos.size() == b.valenceStartInfos.size();
+		difference.indexMismatches = CountMismatches(a.indices, b.indices);
+		difference.friendMismatches = CountMismatches(a.friendsAndSharpnesses, b.friendsAndSharpnesses);
+		difference.valenceStartMismatches = CountMismatches(a.valenceStartInfos, b.valenceStartInfos);
+
+		std::size_t nV = std::min(a.positions.size(), b.positions.size());
+		if (nV == 0) {
+			return difference;
+		}
+
+		// NaN wins every comparison, so a NaN coordinate counts as a mismatch
+		const auto MaxError = [](float x, float y) { return (std::isnan(y) || y > x) ? y : x; };
+
+		std::vector<float> errors(nV);
+		std::vector<std::uint32_t> ulps(nV);
+		std::vector<std::uint8_t> used(nV);
+		auto vertexView = std::views::iota(std::size_t(0), nV);
+		std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](std::size_t vertex) {
+			float error = 0.f;
+			std::uint32_t ulp = 0;
+			// slots no quad references keep whatever the refinement left there
+			int corner = (vertex < a.valenceStartInfos.size()) ? a.valenceStartInfos[vertex] : -1;
+			used[vertex] = corner >= 0 && std::size_t(corner) < a.indices.size() && std::size_t(a.indices[corner]) == vertex;
+			for (int i = 0; used[vertex] && i < 3; ++i) {
+				error = MaxError(error, glm::abs(a.positions[vertex][i] - b.positions[vertex][i]));
+				ulp = glm::max(ulp, UlpDistance(a.positions[vertex][i], b.positions[vertex][i]));
+			}
+			errors[vertex] = error;
+			ulps[vertex] = ulp;
+			});
+
+		struct Sums {
+			double error = 0.0;
+			double squared = 0.0;
+			float maxError = 0.f;
+			std::uint32_t maxUlps = 0;
+			std::size_t mismatches = 0;
+			std::size_t used = 0;
+		};
+		Sums sums = std::transform_reduce(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), Sums{},
+			[&](const Sums& x, const Sums& y) {
+				return Sums{ x.error + y.error, x.squared + y.squared, MaxError(x.maxError, y.maxError),
+					glm::max(x.maxUlps, y.maxUlps), x.mismatches + y.mismatches, x.used + y.used };
+			},
+			[&](std::size_t vertex) {
+				float error = errors[vertex];
+				return Sums{ error, double(error) * error, error, ulps[vertex], std::size_t(!(error <= positionEpsilon)), used[vertex] };
+			});
+
+		difference.positionMismatches = sums.mismatches;
+		difference.maxError = sums.maxError;
+		difference.maxUlps = sums.maxUlps;
+		difference.comparedVertices = sums.used;
+		difference.meanError = (sums.used > 0) ? sums.error / sums.used : 0.0;
+		difference.rmsError = (sums.used > 0) ? std::sqrt(sums.squared / sums.used) : 0.0;
+
+		// NaN sorts as the largest error
+		const auto Worse = [&](std::size_t x, std::size_t y) {
+			float ex = std::isnan(errors[x]) ? std::numeric_limits<float>::infinity() : errors[x];
+			float ey = std::isnan(errors[y]) ? std::numeric_limits<float>::infinity() : errors[y];
+			return (ex != ey) ? ex > ey : x < y;
+			};
+		std::vector<std::size_t> order(nV);
+		std::iota(order.begin(), order.end(), std::size_t(0));
+		std::size_t nWorst = std::min<std::size_t>(std::max(worstCount, 0), nV);
+		std::partial_sort(order.begin(), order.begin() + nWorst, order.end(), Worse);
+		for (std::size_t i = 0; i < nWorst && errors[order[i]] != 0.f; ++i) {
+			difference.worst.push_back({ order[i], errors[order[i]], ulps[order[i]] });
+		}
+		return difference;
+	}
+
+#define EDGEFRIEND_INSTANTIATE_PRIMVAR(N) \
+	template EdgefriendGeometry SubdivideToEdgefriendGeometry<N>( \
+		std::vector<glm::vec3>, std::vector<int>, std::vector<int>, ankerl::unordered_dense::map<glm::ivec2, float>, \
+		const std::vector<Primvar<N>>&, std::vector<Primvar<N>>&); \
+	template EdgefriendGeometry SubdivideEdgefriendGeometry<N>( \
+		const EdgefriendGeometry&, const std::vector<Primvar<N>>&, std::vector<Primvar<N>>&); \
+	template EdgefriendGeometry SubdivideToEdgefriendGeometry<N>( \
+		std::vector<glm::vec3>, std::vector<int>, std::vector<int>, ankerl::unordered_dense::map<glm::ivec2, float>, \
+		const std::vector<Primvar<N>>&, const std::vector<int>&, FaceVaryingPrimvar<N>&); \
+	template EdgefriendGeometry SubdivideEdgefriendGeometry<N>( \
+		const EdgefriendGeometry&, const FaceVaryingPrimvar<N>&, FaceVaryingPrimvar<N>&);
+
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(1)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(2)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(3)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(4)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(5)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(6)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(7)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(8)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(9)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(10)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(11)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(12)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(13)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(14)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(15)
+	EDGEFRIEND_INSTANTIATE_PRIMVAR(16)
 }
\ No newline at end of file
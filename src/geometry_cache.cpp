@@ -0,0 +1,150 @@
+#include "geometry_cache.h"
+#include "binary_io.h"
+#include "stable_hash.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <random>
+#include <stdexcept>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+namespace BinaryIO {
+
+namespace {
+
+constexpr auto entryExtension = ".efg";
+
+template<typename T>
+std::uint64_t HashArray(const std::vector<T>& values) {
+    return StableHash::Hash(values.data(), values.size() * sizeof(T));
+}
+
+} // anonymous namespace
+
+GeometryCache::GeometryCache(std::filesystem::path directory, std::uintmax_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {
+    // a directory that cannot be created makes every load a miss
+    std::error_code error;
+    std::filesystem::create_directories(this->directory, error);
+}
+
+std::uint64_t GeometryCache::Key(const ObjIO::RawMesh& mesh) {
+    std::vector<std::tuple<int, int, float>> creases;
+    creases.reserve(mesh.creases.size());
+    for (const auto& [edge, sharpness] : mesh.creases) {
+        creases.emplace_back(edge.x, edge.y, sharpness);
+    }
+    std::sort(creases.begin(), creases.end());
+
+    const std::array<std::uint64_t, 10> parts = {
+        cacheVersion, geometryVersion,
+        mesh.positions.size(), mesh.indices.size(), mesh.indicesOffsets.size(), creases.size(),
+        HashArray(mesh.positions), HashArray(mesh.indices), HashArray(mesh.indicesOffsets), HashArray(creases) };
+    return StableHash::Hash(parts.data(), sizeof(parts));
+}
+
+std::filesystem::path GeometryCache::EntryPath(std::uint64_t key) const {
+    char name[16];
+    auto end = std::to_chars(name, name + sizeof(name), key, 16).ptr;
+    return directory / (std::string(name, end) + entryExtension);
+}
+
+Edgefriend::EdgefriendGeometry GeometryCache::Load(const ObjIO::RawMesh& mesh) {
+    const std::uint64_t key = Key(mesh);
+    const std::filesystem::path path = EntryPath(key);
+
+    std::error_code error;
+    if (std::filesystem::exists(path, error)) {
+        try {
+            Edgefriend::EdgefriendGeometry geometry = MappedGeometry(path).Copy();
+            // the modification time orders the entries for eviction
+            std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+            std::lock_guard lock(mutex);
+            ++statistics.hits;
+            return geometry;
+        }
+        catch (const std::runtime_error&) {
+            // damaged or from another format version, recomputed and replaced below
+        }
+    }
+
+    Edgefriend::EdgefriendGeometry geometry =
+        Edgefriend::SubdivideToEdgefriendGeometry(mesh.positions, mesh.indices, mesh.indicesOffsets, mesh.creases);
+    {
+        std::lock_guard lock(mutex);
+        ++statistics.misses;
+    }
+    Store(key, geometry);
+    return geometry;
+}
+
+GeometryCache::Statistics GeometryCache::GetStatistics() const {
+    std::lock_guard lock(mutex);
+    return statistics;
+}
+
+void GeometryCache::Store(std::uint64_t key, const Edgefriend::EdgefriendGeometry& geometry) {
+    const std::filesystem::path path = EntryPath(key);
+    // unique across the threads and processes sharing the directory
+    std::random_device device;
+    const std::uint64_t suffix = (std::uint64_t(device()) << 32) | device();
+    char name[16];
+    auto end = std::to_chars(name, name + sizeof(name), suffix, 16).ptr;
+    std::filesystem::path temporary = path;
+    temporary += ".tmp" + std::string(name, end);
+
+    // readers only ever see complete entries, and a full or read-only directory only costs the entry
+    std::error_code error;
+    try {
+        WriteGeometry(temporary, geometry, 0);
+    }
+    catch (const std::runtime_error&) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+    Evict();
+}
+
+void GeometryCache::Evict() {
+    struct Entry {
+        std::filesystem::path path;
+        std::filesystem::file_time_type time;
+        std::uintmax_t size;
+    };
+
+    std::lock_guard lock(mutex);
+    std::vector<Entry> entries;
+    std::uintmax_t bytes = 0;
+    std::error_code error;
+    for (const auto& file : std::filesystem::directory_iterator(directory, error)) {
+        if (file.path().extension() != entryExtension) {
+            continue;
+        }
+        Entry entry{ file.path(), file.last_write_time(error), file.file_size(error) };
+        if (!error) {
+            bytes += entry.size;
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+    for (const Entry& entry : entries) {
+        if (bytes <= maxBytes) {
+            break;
+        }
+        if (std::filesystem::remove(entry.path, error)) {
+            bytes -= entry.size;
+            ++statistics.evictions;
+        }
+    }
+    statistics.bytes = bytes;
+}
+
+} // namespace BinaryIO
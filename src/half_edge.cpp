@@ -0,0 +1,327 @@
+#include "half_edge.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <execution>
+#include <numeric>
+#include <ranges>
+#include <stdexcept>
+
+#define EXECUTION_POLICY std::execution::par
+
+namespace HalfEdge {
+
+namespace {
+
+std::uint64_t DirectedEdge(int from, int to) {
+    return (std::uint64_t(std::uint32_t(from)) << 32) | std::uint32_t(to);
+}
+
+float Sharpness(const ankerl::unordered_dense::map<glm::ivec2, float>& creases, int a, int b) {
+    auto it = creases.find(glm::ivec2(std::min(a, b), std::max(a, b)));
+    return (it == creases.end()) ? 0.f : it->second;
+}
+
+template<typename T>
+std::size_t Bytes(const std::vector<T>& values) {
+    return values.capacity() * sizeof(T);
+}
+
+} // namespace
+
+Mesh BuildMesh(const std::vector<glm::vec3>& positions,
+               const std::vector<int>& indices,
+               const std::vector<int>& indicesOffsets,
+               const ankerl::unordered_dense::map<glm::ivec2, float>& creases) {
+    Mesh mesh;
+    mesh.positions = positions;
+    mesh.origins = indices;
+    mesh.faceOffsets = indicesOffsets;
+    mesh.faceOffsets.push_back(int(indices.size()));
+    mesh.realHalfEdges = int(indices.size());
+
+    const int nF = int(indicesOffsets.size());
+    for (int f = 0; f < nF; ++f) {
+        int begin = mesh.faceOffsets[f];
+        int end = mesh.faceOffsets[f + 1];
+        for (int h = begin; h < end; ++h) {
+            mesh.nexts.push_back((h + 1 < end) ? h + 1 : begin);
+            mesh.prevs.push_back((h > begin) ? h - 1 : end - 1);
+            mesh.faces.push_back(f);
+        }
+    }
+
+    ankerl::unordered_dense::map<std::uint64_t, int> halfEdges;
+    halfEdges.reserve(indices.size());
+    for (int h = 0; h < mesh.realHalfEdges; ++h) {
+        if (!halfEdges.emplace(DirectedEdge(mesh.origins[h], mesh.origins[mesh.nexts[h]]), h).second) {
+            throw std::invalid_argument("Half-edge mesh needs a manifold, consistently oriented input.");
+        }
+    }
+
+    mesh.twins.assign(indices.size(), -1);
+    for (int h = 0; h < mesh.realHalfEdges; ++h) {
+        auto it = halfEdges.find(DirectedEdge(mesh.origins[mesh.nexts[h]], mesh.origins[h]));
+        if (it != halfEdges.end()) {
+            mesh.twins[h] = it->second;
+        }
+    }
+
+    // --- close every border loop with one face ---
+    for (int border = 0; border < mesh.realHalfEdges; ++border) {
+        if (mesh.twins[border] >= 0) {
+            continue;
+        }
+
+        int face = int(mesh.faceOffsets.size()) - 1;
+        int begin = int(mesh.origins.size());
+        int h = border;
+        do {
+            // the closing half-edge runs against h; the next border half-edge ends where h starts
+            int ghost = int(mesh.origins.size());
+            mesh.origins.push_back(mesh.origins[mesh.nexts[h]]);
+            mesh.faces.push_back(face);
+            mesh.twins.push_back(h);
+            mesh.twins[h] = ghost;
+
+            // the loop ends on border, whose twin is already the first closing half-edge
+            int incoming = mesh.prevs[h];
+            while (mesh.twins[incoming] >= 0 && mesh.twins[incoming] < mesh.realHalfEdges) {
+                incoming = mesh.prevs[mesh.twins[incoming]];
+            }
+            if (mesh.twins[incoming] >= 0 && incoming != border) {
+                throw std::invalid_argument("Half-edge mesh needs a manifold, consistently oriented input.");
+            }
+            h = incoming;
+        } while (h != border);
+
+        int end = int(mesh.origins.size());
+        for (int g = begin; g < end; ++g) {
+            mesh.nexts.push_back((g + 1 < end) ? g + 1 : begin);
+            mesh.prevs.push_back((g > begin) ? g - 1 : end - 1);
+        }
+        mesh.faceOffsets.push_back(end);
+    }
+
+    mesh.sharpnesses.resize(mesh.origins.size());
+    for (std::size_t h = 0; h < mesh.origins.size(); ++h) {
+        mesh.sharpnesses[h] = Sharpness(creases, mesh.origins[h], mesh.origins[mesh.nexts[h]]);
+    }
+
+    mesh.vertexHalfEdges.assign(positions.size(), -1);
+    for (std::size_t h = 0; h < mesh.origins.size(); ++h) {
+        mesh.vertexHalfEdges[mesh.origins[h]] = int(h);
+    }
+    return mesh;
+}
+
+Mesh SubdivideMesh(const Mesh& mesh) {
+    const int oV = int(mesh.positions.size());
+    const int oF = int(mesh.faceOffsets.size()) - 1;
+    const int oH = int(mesh.origins.size());
+
+    // --- number the edges, once per half-edge pair ---
+    std::vector<int> edgeIds(oH);
+    auto halfEdgeView = std::views::iota(0, oH);
+    std::transform_exclusive_scan(EXECUTION_POLICY, halfEdgeView.begin(), halfEdgeView.end(), edgeIds.begin(), 0,
+        std::plus<>(), [&](int h) { return int(h < mesh.twins[h]); });
+    const int oE = oH / 2;
+
+    const auto EdgeVertex = [&](int h) {
+        return oV + oF + edgeIds[std::min(h, mesh.twins[h])];
+    };
+
+    Mesh neu;
+    neu.positions.resize(oV + oF + oE);
+
+    // --- face points ---
+    auto faceView = std::views::iota(0, oF);
+    std::for_each(EXECUTION_POLICY, faceView.begin(), faceView.end(), [&](int f) {
+        glm::vec3 facePoint(0, 0, 0);
+        for (int h = mesh.faceOffsets[f]; h < mesh.faceOffsets[f + 1]; ++h) {
+            facePoint += mesh.positions[mesh.origins[h]];
+        }
+        neu.positions[oV + f] = facePoint / float(mesh.faceOffsets[f + 1] - mesh.faceOffsets[f]);
+    });
+
+    // --- edge points ---
+    std::for_each(EXECUTION_POLICY, halfEdgeView.begin(), halfEdgeView.end(), [&](int h) {
+        int twin = mesh.twins[h];
+        if (h > twin) {
+            return;
+        }
+        const glm::vec3& a = mesh.positions[mesh.origins[h]];
+        const glm::vec3& b = mesh.positions[mesh.origins[twin]];
+        glm::vec3 smooth = (a + b + neu.positions[oV + mesh.faces[h]] + neu.positions[oV + mesh.faces[twin]]) * .25f;
+        glm::vec3 sharp = (a + b) * .5f;
+        neu.positions[EdgeVertex(h)] = glm::mix(smooth, sharp, glm::min(1.f, mesh.sharpnesses[h]));
+    });
+
+    // --- vertex points ---
+    auto vertexView = std::views::iota(0, oV);
+    std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](int v) {
+        const glm::vec3& V = mesh.positions[v];
+        int start = mesh.vertexHalfEdges[v];
+        if (start < 0) {
+            neu.positions[v] = V;
+            return;
+        }
+
+        glm::vec3 Q(0, 0, 0);
+        glm::vec3 R(0, 0, 0);
+        glm::vec3 sharpA{};
+        glm::vec3 sharpB{};
+        int sharpCount = 0;
+        float sharpnessSum = 0.f;
+        int n = 0;
+
+        int h = start;
+        do {
+            ++n;
+            const glm::vec3& E = mesh.positions[mesh.origins[mesh.nexts[h]]];
+            R += E + V;
+            Q += neu.positions[oV + mesh.faces[h]];
+
+            float sharpness = mesh.sharpnesses[h];
+            sharpnessSum += sharpness;
+            if (sharpness > 0) {
+                ((sharpCount == 0) ? sharpA : sharpB) = E;
+                ++sharpCount;
+            }
+            h = mesh.nexts[mesh.twins[h]];
+        } while (h != start);
+
+        float ninv = 1.f / n;
+        glm::vec3 smoothRule = ((Q * ninv) + (R * ninv) + (n - 3.f) * V) * ninv;
+        glm::vec3 creaseRule = sharpA * .125f + V * .75f + sharpB * .125f;
+
+        float vs = sharpnessSum / sharpCount;
+        if (sharpCount < 2) {
+            neu.positions[v] = smoothRule;
+        }
+        else if (sharpCount > 2) {
+            neu.positions[v] = glm::mix(smoothRule, V, std::min(vs, 1.f));
+        }
+        else {
+            neu.positions[v] = glm::mix(smoothRule, creaseRule, std::min(vs, 1.f));
+        }
+    });
+
+    // --- topology: half-edge h becomes the quad (origin, edge point, face point, edge point of prev) ---
+    neu.origins.resize(4 * oH);
+    neu.nexts.resize(4 * oH);
+    neu.prevs.resize(4 * oH);
+    neu.twins.resize(4 * oH);
+    neu.faces.resize(4 * oH);
+    neu.sharpnesses.resize(4 * oH);
+    neu.faceOffsets.resize(oH + 1);
+    neu.vertexHalfEdges.resize(neu.positions.size());
+    neu.realHalfEdges = 4 * mesh.realHalfEdges;
+    neu.faceOffsets[oH] = 4 * oH;
+
+    std::for_each(EXECUTION_POLICY, halfEdgeView.begin(), halfEdgeView.end(), [&](int h) {
+        int prev = mesh.prevs[h];
+        int next = mesh.nexts[h];
+        int twin = mesh.twins[h];
+
+        neu.origins[4 * h + 0] = mesh.origins[h];
+        neu.origins[4 * h + 1] = EdgeVertex(h);
+        neu.origins[4 * h + 2] = oV + mesh.faces[h];
+        neu.origins[4 * h + 3] = EdgeVertex(prev);
+
+        neu.twins[4 * h + 0] = 4 * mesh.nexts[twin] + 3;
+        neu.twins[4 * h + 1] = 4 * next + 2;
+        neu.twins[4 * h + 2] = 4 * prev + 1;
+        neu.twins[4 * h + 3] = 4 * mesh.twins[prev] + 0;
+
+        neu.sharpnesses[4 * h + 0] = std::max(0.f, mesh.sharpnesses[h] - 1.f);
+        neu.sharpnesses[4 * h + 1] = 0.f;
+        neu.sharpnesses[4 * h + 2] = 0.f;
+        neu.sharpnesses[4 * h + 3] = std::max(0.f, mesh.sharpnesses[prev] - 1.f);
+
+        for (int i = 0; i < 4; ++i) {
+            neu.nexts[4 * h + i] = 4 * h + (i + 1) % 4;
+            neu.prevs[4 * h + i] = 4 * h + (i + 3) % 4;
+            neu.faces[4 * h + i] = h;
+        }
+        neu.faceOffsets[h] = 4 * h;
+
+        if (h < twin) {
+            neu.vertexHalfEdges[EdgeVertex(h)] = 4 * h + 1;
+        }
+        if (h == mesh.faceOffsets[mesh.faces[h]]) {
+            neu.vertexHalfEdges[oV + mesh.faces[h]] = 4 * h + 2;
+        }
+    });
+
+    std::for_each(EXECUTION_POLICY, vertexView.begin(), vertexView.end(), [&](int v) {
+        int h = mesh.vertexHalfEdges[v];
+        neu.vertexHalfEdges[v] = (h < 0) ? -1 : 4 * h;
+    });
+    return neu;
+}
+
+std::size_t MemoryBytes(const Mesh& mesh) {
+    return Bytes(mesh.positions) + Bytes(mesh.origins) + Bytes(mesh.nexts) + Bytes(mesh.prevs) + Bytes(mesh.twins) +
+        Bytes(mesh.faces) + Bytes(mesh.sharpnesses) + Bytes(mesh.faceOffsets) + Bytes(mesh.vertexHalfEdges);
+}
+
+std::size_t MemoryBytes(const Edgefriend::EdgefriendGeometry& geometry) {
+    return Bytes(geometry.positions) + Bytes(geometry.indices) + Bytes(geometry.friendsAndSharpnesses) +
+        Bytes(geometry.valenceStartInfos);
+}
+
+Comparison CompareWithEdgefriend(const std::vector<glm::vec3>& positions,
+                                 const std::vector<int>& indices,
+                                 const std::vector<int>& indicesOffsets,
+                                 const ankerl::unordered_dense::map<glm::ivec2, float>& creases,
+                                 int levels,
+                                 float tolerance) {
+    if (levels < 1) {
+        throw std::invalid_argument("Comparison needs at least one level.");
+    }
+
+    using Clock = std::chrono::steady_clock;
+    Comparison comparison;
+    comparison.levels = levels;
+
+    auto start = Clock::now();
+    Edgefriend::EdgefriendGeometry geometry =
+        Edgefriend::SubdivideToEdgefriendGeometry(positions, indices, indicesOffsets, creases);
+    for (int level = 1; level < levels; ++level) {
+        geometry = Edgefriend::SubdivideEdgefriendGeometry(geometry);
+    }
+    comparison.edgefriendSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    start = Clock::now();
+    Mesh mesh = BuildMesh(positions, indices, indicesOffsets, creases);
+    for (int level = 0; level < levels; ++level) {
+        mesh = SubdivideMesh(mesh);
+    }
+    comparison.halfEdgeSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    comparison.edgefriendBytes = MemoryBytes(geometry);
+    comparison.halfEdgeBytes = MemoryBytes(mesh);
+
+    // both engines number the quads refining the input corners alike; the border-closing faces may differ in order
+    comparison.comparedQuads = std::size_t(indices.size()) << (2 * (levels - 1));
+    std::vector<float> errors(comparison.comparedQuads);
+    auto quadView = std::views::iota(std::size_t(0), comparison.comparedQuads);
+    std::for_each(EXECUTION_POLICY, quadView.begin(), quadView.end(), [&](std::size_t quad) {
+        float error = 0.f;
+        for (int i = 0; i < 4; ++i) {
+            const glm::vec3& a = geometry.positions[geometry.indices[4 * quad + i]];
+            const glm::vec3& b = mesh.positions[mesh.origins[4 * quad + i]];
+            error = std::max(error, glm::length(a - b));
+        }
+        errors[quad] = error;
+    });
+
+    for (float error : errors) {
+        comparison.maxError = std::max(comparison.maxError, error);
+        comparison.mismatches += (error > tolerance);
+    }
+    return comparison;
+}
+
+} // namespace HalfEdge
@@ -1,53 +1,203 @@
 #include "obj_io.h"
+#include "binary_io.h"
 #include "rapidobj.hpp"
 #include <fstream>
-#include <sstream>
 #include <span>
 #include <algorithm>
+#include <charconv>
+#include <execution>
+#include <functional>
 #include <iostream>
+#include <numeric>
+#include <ranges>
 #include <stdexcept>
+#include <thread>
 
 namespace ObjIO {
 
 namespace {
 
-struct ParsedObjData {
+struct ObjRecords {
     std::vector<glm::vec3> vertices;
     std::vector<glm::ivec4> faces;
 };
 
-int ParseIndexToken(const std::string& token) {
-    const auto slash = token.find('/');
-    return std::stoi((slash == std::string::npos) ? token : token.substr(0, slash));
+const char* SkipBlanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
 }
 
-ParsedObjData ParseObjForComparison(const std::filesystem::path& path) {
-    std::ifstream input(path);
-    if (!input.is_open()) {
-        throw std::runtime_error("Failed to open OBJ file: " + path.string());
+bool IsRecordLine(const char* begin, const char* lineEnd, char kind) {
+    return lineEnd - begin > 2 && begin[1] == ' ' && begin[0] == kind;
+}
+
+// "v x y z" or "f a b c d" lines, as given by kind; faces keep the position index of their first four corners,
+// lines that do not parse are skipped.
+void ParseObjLines(const char* begin, const char* end, char kind, ObjRecords& records) {
+    while (begin < end) {
+        const char* lineEnd = std::find(begin, end, '\n');
+        if (IsRecordLine(begin, lineEnd, kind)) {
+            const char* p = begin + 2;
+            if (kind == 'v') {
+                glm::vec3 v{};
+                bool ok = true;
+                for (int i = 0; i < 3 && ok; ++i) {
+                    auto [next, error] = std::from_chars(SkipBlanks(p, lineEnd), lineEnd, v[i]);
+                    ok = (error == std::errc());
+                    p = next;
+                }
+                if (ok) records.vertices.push_back(v);
+            }
+            else {
+                glm::ivec4 f{};
+                bool ok = true;
+                for (int i = 0; i < 4 && ok; ++i) {
+                    auto [next, error] = std::from_chars(SkipBlanks(p, lineEnd), lineEnd, f[i]);
+                    ok = (error == std::errc());
+                    p = next;
+                    while (p < lineEnd && *p != ' ' && *p != '\t') ++p; // texcoord and normal indices
+                }
+                if (ok) records.faces.push_back(f);
+            }
+        }
+        begin = (lineEnd == end) ? end : lineEnd + 1;
+    }
+}
+
+// Parses the records of one kind of a mapped OBJ window by window, each window split at line ends and parsed
+// in parallel. Vertices and faces get a stream each, so neither piles up while the other is read.
+class ObjRecordStream {
+public:
+    ObjRecordStream(const std::filesystem::path& path, char kind)
+        : file(path), kind(kind) {}
+
+    // Appends the records of the next window, false once the file is exhausted.
+    bool Next(ObjRecords& records) {
+        if (offset >= Size()) {
+            return false;
+        }
+
+        const std::size_t windowEnd = LineEnd(offset + windowBytes);
+        const std::vector<std::size_t> bounds = Split(offset, windowEnd);
+        auto partView = std::views::iota(std::size_t(0), parts.size());
+        std::for_each(std::execution::par, partView.begin(), partView.end(), [&](std::size_t i) {
+            parts[i].vertices.clear();
+            parts[i].faces.clear();
+            ParseObjLines(Data() + bounds[i], Data() + bounds[i + 1], kind, parts[i]);
+        });
+        for (const ObjRecords& part : parts) {
+            records.vertices.insert(records.vertices.end(), part.vertices.begin(), part.vertices.end());
+            records.faces.insert(records.faces.end(), part.faces.begin(), part.faces.end());
+        }
+        offset = windowEnd;
+        return true;
+    }
+
+    // Lines of the kind in the whole file, counted without parsing them.
+    std::size_t Count() const {
+        const std::vector<std::size_t> bounds = Split(0, Size());
+        std::vector<std::size_t> counts(parts.size(), 0);
+        auto partView = std::views::iota(std::size_t(0), parts.size());
+        std::for_each(std::execution::par, partView.begin(), partView.end(), [&](std::size_t i) {
+            const char* begin = Data() + bounds[i];
+            const char* end = Data() + bounds[i + 1];
+            while (begin < end) {
+                const char* lineEnd = std::find(begin, end, '\n');
+                counts[i] += IsRecordLine(begin, lineEnd, kind);
+                begin = (lineEnd == end) ? end : lineEnd + 1;
+            }
+        });
+        return std::accumulate(counts.begin(), counts.end(), std::size_t(0));
+    }
+
+private:
+    static constexpr std::size_t windowBytes = std::size_t(1) << 26;
+
+    const char* Data() const { return reinterpret_cast<const char*>(file.Bytes().data()); }
+    std::size_t Size() const { return file.Bytes().size(); }
+
+    // one past the newline ending the line at position
+    std::size_t LineEnd(std::size_t position) const {
+        if (position >= Size()) return Size();
+        const char* newline = std::find(Data() + position, Data() + Size(), '\n');
+        return std::min<std::size_t>(newline - Data() + 1, Size());
     }
 
-    ParsedObjData data;
-    std::string line;
-    while (std::getline(input, line)) {
-        if (line.size() > 2 && line[0] == 'v' && line[1] == ' ') {
-            std::istringstream s(line.substr(2));
-            glm::vec3 v{};
-            s >> v.x >> v.y >> v.z;
-            if (!s.fail()) data.vertices.push_back(v);
+    // one range per part, split at line ends
+    std::vector<std::size_t> Split(std::size_t begin, std::size_t end) const {
+        std::vector<std::size_t> bounds(parts.size() + 1, end);
+        bounds[0] = begin;
+        for (std::size_t i = 1; i < parts.size(); ++i) {
+            bounds[i] = std::max(bounds[i - 1], std::min(end, LineEnd(begin + i * (end - begin) / parts.size())));
         }
-        else if (line.size() > 2 && line[0] == 'f' && line[1] == ' ') {
-            std::istringstream s(line.substr(2));
-            std::string t0, t1, t2, t3;
-            s >> t0 >> t1 >> t2 >> t3;
-            if (!s.fail()) {
-                data.faces.emplace_back(
-                    ParseIndexToken(t0), ParseIndexToken(t1),
-                    ParseIndexToken(t2), ParseIndexToken(t3));
+        return bounds;
+    }
+
+    BinaryIO::MappedFile file;
+    char kind;
+    std::size_t offset = 0;
+    std::vector<ObjRecords> parts = std::vector<ObjRecords>(std::max(1u, std::thread::hardware_concurrency()));
+};
+
+std::ofstream OpenForWriting(const std::filesystem::path& path) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Failed to open output file: " + path.string());
+    }
+    return out;
+}
+
+// Longest line any writer emits: "v" and three floats of at most 9 significant digits, or "f" and four indices.
+constexpr std::size_t maxLineLength = 64;
+constexpr std::size_t linesPerChunk = 1 << 14;
+
+// Formats chunks of lines in parallel, a batch of chunks at a time, and writes each batch in order,
+// so the memory stays bounded while the disk gets large sequential writes.
+template<typename Format>
+void WriteLines(std::ofstream& out, std::size_t lineCount, Format format) {
+    const std::size_t nChunks = (lineCount + linesPerChunk - 1) / linesPerChunk;
+    const std::size_t batchSize = 4 * std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::vector<char>> buffers(std::min(nChunks, batchSize));
+    std::vector<std::size_t> lengths(buffers.size());
+    for (std::size_t batch = 0; batch < nChunks; batch += batchSize) {
+        const std::size_t batchEnd = std::min(nChunks, batch + batchSize);
+        auto chunkView = std::views::iota(batch, batchEnd);
+        std::for_each(std::execution::par, chunkView.begin(), chunkView.end(), [&](std::size_t chunk) {
+            std::vector<char>& buffer = buffers[chunk - batch];
+            buffer.resize(linesPerChunk * maxLineLength);
+            char* cursor = buffer.data();
+            const std::size_t end = std::min(lineCount, (chunk + 1) * linesPerChunk);
+            for (std::size_t line = chunk * linesPerChunk; line < end; ++line) {
+                cursor = format(line, cursor);
             }
+            lengths[chunk - batch] = cursor - buffer.data();
+        });
+        for (std::size_t chunk = batch; chunk < batchEnd; ++chunk) {
+            out.write(buffers[chunk - batch].data(), lengths[chunk - batch]);
         }
     }
-    return data;
+    if (!out) {
+        throw std::runtime_error("Failed to write output file.");
+    }
+}
+
+// precision 6 matches the default stream formatting, 0 writes the shortest text that reads back exactly.
+void WriteVertices(std::ofstream& out, const std::vector<glm::vec3>& positions, int precision) {
+    if (precision < 0 || precision > 9) {
+        throw std::invalid_argument("OBJ float precision has to be between 0 and 9.");
+    }
+    WriteLines(out, positions.size(), [&](std::size_t i, char* cursor) {
+        *cursor++ = 'v';
+        for (int j = 0; j < 3; ++j) {
+            *cursor++ = ' ';
+            cursor = (precision == 0)
+                ? std::to_chars(cursor, cursor + 16, positions[i][j]).ptr
+                : std::to_chars(cursor, cursor + 16, positions[i][j], std::chars_format::general, precision).ptr;
+        }
+        *cursor++ = '\n';
+        return cursor;
+    });
 }
 
 } // anonymous namespace
@@ -60,97 +210,245 @@ RawMesh LoadRawMesh(const std::filesystem::path& path) {
     if (model.shapes.empty()) {
         throw std::runtime_error("OBJ file does not contain a mesh: " + path.string());
     }
-    if (model.shapes.size() != 1) {
-        std::cerr << "Warning: only processing the first shape/object.\n";
+
+    // every rapidobj array is released as soon as it is converted, the largest first, to keep the peak low;
+    // shapes index the shared attribute arrays, so their faces are concatenated as they are
+    RawMesh result;
+    std::size_t nIndices = 0;
+    std::size_t nFaces = 0;
+    std::size_t nCreases = 0;
+    bool hasMaterials = true;
+    bool hasTexcoords = true;
+    for (const auto& shape : model.shapes) {
+        result.shapeFaceOffsets.push_back(int(nFaces));
+        result.shapeNames.push_back(shape.name);
+        nIndices += shape.mesh.indices.size();
+        nFaces += shape.mesh.num_face_vertices.size();
+        nCreases += shape.mesh.creases.size();
+        hasMaterials = hasMaterials && shape.mesh.material_ids.size() == shape.mesh.num_face_vertices.size();
+        hasTexcoords = hasTexcoords && std::all_of(std::execution::par, shape.mesh.indices.begin(), shape.mesh.indices.end(),
+            [](const rapidobj::Index& idx) { return idx.texcoord_index >= 0; });
     }
+    hasTexcoords = hasTexcoords && nIndices > 0;
 
-    const auto& mesh = model.shapes.front().mesh;
+    result.indices.resize(nIndices);
+    if (hasTexcoords) {
+        result.texcoordIndices.resize(nIndices);
+    }
+    std::size_t indexOffset = 0;
+    for (auto& shape : model.shapes) {
+        auto& mesh = shape.mesh;
+        std::transform(std::execution::par, mesh.indices.begin(), mesh.indices.end(), result.indices.begin() + indexOffset,
+            [](const rapidobj::Index& idx) { return idx.position_index; });
+        if (hasTexcoords) {
+            std::transform(std::execution::par, mesh.indices.begin(), mesh.indices.end(), result.texcoordIndices.begin() + indexOffset,
+                [](const rapidobj::Index& idx) { return idx.texcoord_index; });
+        }
+        indexOffset += mesh.indices.size();
+        mesh.indices = {};
+    }
+    if (hasTexcoords) {
+        auto texcoordSpan = std::span<const glm::vec2>(
+            reinterpret_cast<const glm::vec2*>(model.attributes.texcoords.data()),
+            model.attributes.texcoords.size() / 2);
+        result.texcoords.assign(texcoordSpan.begin(), texcoordSpan.end());
+    }
+    model.attributes.texcoords = {};
+    model.attributes.normals = {};
 
-    auto posSpan = std::span<glm::vec3>(
-        reinterpret_cast<glm::vec3*>(model.attributes.positions.data()),
+    auto posSpan = std::span<const glm::vec3>(
+        reinterpret_cast<const glm::vec3*>(model.attributes.positions.data()),
         model.attributes.positions.size() / 3);
+    result.positions.resize(posSpan.size());
+    std::copy(std::execution::par, posSpan.begin(), posSpan.end(), result.positions.begin());
 
-    RawMesh result;
-    result.positions.assign(posSpan.begin(), posSpan.end());
+    if (model.attributes.colors.size() == model.attributes.positions.size()) {
+        auto colorSpan = std::span<const glm::vec3>(
+            reinterpret_cast<const glm::vec3*>(model.attributes.colors.data()),
+            model.attributes.colors.size() / 3);
+        result.colors.resize(colorSpan.size());
+        std::copy(std::execution::par, colorSpan.begin(), colorSpan.end(), result.colors.begin());
+    }
+    model.attributes.positions = {};
+    model.attributes.colors = {};
 
-    result.indices.reserve(mesh.indices.size());
-    std::transform(mesh.indices.begin(), mesh.indices.end(),
-        std::back_inserter(result.indices),
-        [](const rapidobj::Index& idx) { return idx.position_index; });
+    // face offsets continue across shapes
+    result.indicesOffsets.resize(nFaces);
+    if (hasMaterials) {
+        result.materialIds.reserve(nFaces);
+    }
+    int faceOffset = 0;
+    int cornerOffset = 0;
+    for (auto& shape : model.shapes) {
+        auto& mesh = shape.mesh;
+        std::transform_exclusive_scan(std::execution::par,
+            mesh.num_face_vertices.begin(), mesh.num_face_vertices.end(), result.indicesOffsets.begin() + faceOffset,
+            cornerOffset, std::plus<>(), [](std::uint8_t faceSize) { return int(faceSize); });
+        faceOffset += mesh.num_face_vertices.size();
+        cornerOffset += std::transform_reduce(std::execution::par,
+            mesh.num_face_vertices.begin(), mesh.num_face_vertices.end(), 0,
+            std::plus<>(), [](std::uint8_t faceSize) { return int(faceSize); });
+        mesh.num_face_vertices = {};
 
-    result.indicesOffsets.reserve(mesh.num_face_vertices.size());
-    std::size_t startIndex = 0;
-    for (const auto faceSize : mesh.num_face_vertices) {
-        result.indicesOffsets.push_back(static_cast<int>(startIndex));
-        startIndex += faceSize;
+        if (hasMaterials) {
+            result.materialIds.insert(result.materialIds.end(), mesh.material_ids.begin(), mesh.material_ids.end());
+        }
+        mesh.material_ids = {};
     }
 
-    result.creases.reserve(mesh.creases.size());
-    for (const auto& crease : mesh.creases) {
-        const auto [mn, mx] = std::minmax(crease.position_index_from, crease.position_index_to);
-        result.creases.emplace(glm::ivec2(mn, mx), crease.sharpness);
+    // in file order, so the first of duplicate edges wins
+    result.creases.reserve(nCreases);
+    for (auto& shape : model.shapes) {
+        for (const auto& crease : shape.mesh.creases) {
+            const auto [mn, mx] = std::minmax(crease.position_index_from, crease.position_index_to);
+            result.creases.emplace(glm::ivec2(mn, mx), crease.sharpness);
+        }
+        shape.mesh.creases = {};
     }
 
     return result;
 }
 
-void WriteGeometry(const std::filesystem::path& path,
-                   const Edgefriend::EdgefriendGeometry& geometry) {
-    std::ofstream out(path);
-    if (!out.is_open()) {
-        throw std::runtime_error("Failed to open output file: " + path.string());
+Edgefriend::DisplacementMap LoadDisplacementMap(const std::filesystem::path& path,
+                                                int resolution, int channels) {
+    if (resolution <= 0 || (channels != 1 && channels != 3)) {
+        throw std::invalid_argument("Displacement map needs a positive resolution and 1 or 3 channels.");
     }
 
-    for (const auto& p : geometry.positions) {
-        out << "v " << p.x << ' ' << p.y << ' ' << p.z << '\n';
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input.is_open()) {
+        throw std::runtime_error("Failed to open displacement map: " + path.string());
+    }
+
+    const auto bytes = static_cast<std::size_t>(input.tellg());
+    const std::size_t tileBytes = sizeof(float) * resolution * resolution * channels;
+    if (bytes % tileBytes != 0) {
+        throw std::runtime_error("Displacement map size is not a multiple of the tile size: " + path.string());
+    }
+
+    Edgefriend::DisplacementMap map;
+    map.resolution = resolution;
+    map.channels = channels;
+    map.texels.resize(bytes / sizeof(float));
+
+    input.seekg(0);
+    input.read(reinterpret_cast<char*>(map.texels.data()), bytes);
+    if (!input) {
+        throw std::runtime_error("Failed to read displacement map: " + path.string());
     }
-    for (int i = 0; i < static_cast<int>(geometry.friendsAndSharpnesses.size()); ++i) {
-        out << 'f';
+    return map;
+}
+
+void WriteGeometry(const std::filesystem::path& path,
+                   const Edgefriend::EdgefriendGeometry& geometry,
+                   int precision) {
+    std::ofstream out = OpenForWriting(path);
+    WriteVertices(out, geometry.positions, precision);
+    WriteLines(out, geometry.friendsAndSharpnesses.size(), [&](std::size_t i, char* cursor) {
+        *cursor++ = 'f';
         for (int j = 0; j < 4; ++j) {
-            out << ' ' << geometry.indices[4 * i + j] + 1;
+            *cursor++ = ' ';
+            cursor = std::to_chars(cursor, cursor + 16, geometry.indices[4 * i + j] + 1).ptr;
         }
-        out << '\n';
-    }
+        *cursor++ = '\n';
+        return cursor;
+    });
+}
+
+void WriteTriangles(const std::filesystem::path& path,
+                    const Edgefriend::EdgefriendGeometry& geometry,
+                    const std::vector<std::uint32_t>& triangles,
+                    int precision) {
+    std::ofstream out = OpenForWriting(path);
+    WriteVertices(out, geometry.positions, precision);
+    WriteLines(out, triangles.size() / 3, [&](std::size_t i, char* cursor) {
+        *cursor++ = 'f';
+        for (int j = 0; j < 3; ++j) {
+            *cursor++ = ' ';
+            cursor = std::to_chars(cursor, cursor + 16, triangles[3 * i + j] + 1).ptr;
+        }
+        *cursor++ = '\n';
+        return cursor;
+    });
 }
 
 bool CompareFiles(const std::filesystem::path& pathA,
                   const std::filesystem::path& pathB,
                   float positionEpsilon) {
-    const auto a = ParseObjForComparison(pathA);
-    const auto b = ParseObjForComparison(pathB);
-
-    if (a.vertices.size() != b.vertices.size()) {
-        std::cerr << "[Check] Vertex count mismatch: " << a.vertices.size()
-                  << " vs " << b.vertices.size() << '\n';
-        return false;
-    }
-    if (a.faces.size() != b.faces.size()) {
-        std::cerr << "[Check] Face count mismatch: " << a.faces.size()
-                  << " vs " << b.faces.size() << '\n';
+    const auto CompareCounts = [&](char kind, const char* name) {
+        const std::size_t countA = ObjRecordStream(pathA, kind).Count();
+        const std::size_t countB = ObjRecordStream(pathB, kind).Count();
+        if (countA != countB) {
+            std::cerr << "[Check] " << name << " count mismatch: " << countA << " vs " << countB << '\n';
+            return false;
+        }
+        return true;
+    };
+    if (!CompareCounts('v', "Vertex") || !CompareCounts('f', "Face")) {
         return false;
     }
 
-    for (std::size_t i = 0; i < a.vertices.size(); ++i) {
-        const auto& va = a.vertices[i];
-        const auto& vb = b.vertices[i];
-        if (std::abs(va.x - vb.x) > positionEpsilon ||
-            std::abs(va.y - vb.y) > positionEpsilon ||
-            std::abs(va.z - vb.z) > positionEpsilon) {
-            std::cerr << "[Check] Vertex mismatch at " << i
-                      << ": (" << va.x << ", " << va.y << ", " << va.z
-                      << ") vs (" << vb.x << ", " << vb.y << ", " << vb.z << ")\n";
-            return false;
+    // a file is only read on once its records are compared, so at most a window of each is held
+    const auto CompareRecords = [&](char kind, const char* name, auto member, auto equal, auto report) {
+        ObjRecordStream streamA(pathA, kind);
+        ObjRecordStream streamB(pathB, kind);
+        ObjRecords a, b;
+        auto& recordsA = a.*member;
+        auto& recordsB = b.*member;
+        std::size_t base = 0;
+        bool moreA = true, moreB = true;
+        while (true) {
+            if (recordsA.empty() && moreA) moreA = streamA.Next(a);
+            if (recordsB.empty() && moreB) moreB = streamB.Next(b);
+            if ((recordsA.empty() && !moreA) || (recordsB.empty() && !moreB)) {
+                break;
+            }
+
+            const std::size_t n = std::min(recordsA.size(), recordsB.size());
+            const auto [ra, rb] = std::mismatch(std::execution::par, recordsA.begin(), recordsA.begin() + n,
+                recordsB.begin(), equal);
+            if (ra != recordsA.begin() + n) {
+                std::cerr << "[Check] " << name << " mismatch at " << base + (ra - recordsA.begin());
+                report(*ra, *rb);
+                std::cerr << '\n';
+                return false;
+            }
+            recordsA.erase(recordsA.begin(), recordsA.begin() + n);
+            recordsB.erase(recordsB.begin(), recordsB.begin() + n);
+            base += n;
         }
-    }
 
-    for (std::size_t i = 0; i < a.faces.size(); ++i) {
-        if (a.faces[i] != b.faces[i]) {
-            std::cerr << "[Check] Face mismatch at " << i << '\n';
+        // the line counts matched, but a line that does not parse is skipped in one file only
+        const auto Total = [&](ObjRecordStream& stream, ObjRecords& records, bool more) {
+            std::size_t total = base + (records.*member).size();
+            while (more) {
+                (records.*member).clear();
+                more = stream.Next(records);
+                total += (records.*member).size();
+            }
+            return total;
+        };
+        const std::size_t totalA = Total(streamA, a, moreA);
+        const std::size_t totalB = Total(streamB, b, moreB);
+        if (totalA != totalB) {
+            std::cerr << "[Check] " << name << " count mismatch: " << totalA << " vs " << totalB << '\n';
             return false;
         }
-    }
+        return true;
+    };
 
-    return true;
+    return CompareRecords('v', "Vertex", &ObjRecords::vertices,
+            [&](const glm::vec3& x, const glm::vec3& y) {
+                return std::abs(x.x - y.x) <= positionEpsilon &&
+                       std::abs(x.y - y.y) <= positionEpsilon &&
+                       std::abs(x.z - y.z) <= positionEpsilon;
+            },
+            [](const glm::vec3& va, const glm::vec3& vb) {
+                std::cerr << ": (" << va.x << ", " << va.y << ", " << va.z
+                          << ") vs (" << vb.x << ", " << vb.y << ", " << vb.z << ")";
+            }) &&
+        CompareRecords('f', "Face", &ObjRecords::faces, std::equal_to<>(),
+            [](const glm::ivec4&, const glm::ivec4&) {});
 }
 
 } // namespace ObjIO
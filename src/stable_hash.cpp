@@ -0,0 +1,97 @@
+#include "stable_hash.h"
+#include <array>
+#include <cstring>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace StableHash {
+
+namespace {
+
+constexpr std::array<std::uint64_t, 4> secret = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+                                                  0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+// 128-bit product of a and b, folded by xor
+std::uint64_t Mix(std::uint64_t a, std::uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<std::uint64_t>(product) ^ static_cast<std::uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    std::uint64_t high;
+    std::uint64_t low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    std::uint64_t ha = a >> 32, hb = b >> 32;
+    std::uint64_t la = static_cast<std::uint32_t>(a), lb = static_cast<std::uint32_t>(b);
+    std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    std::uint64_t t = rl + (rm0 << 32);
+    std::uint64_t carry = t < rl;
+    std::uint64_t low = t + (rm1 << 32);
+    carry += low < t;
+    std::uint64_t high = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+    return low ^ high;
+#endif
+}
+
+// the supported platforms are little-endian, like the binary geometry format
+std::uint64_t Read8(const std::uint8_t* p) {
+    std::uint64_t value;
+    std::memcpy(&value, p, 8);
+    return value;
+}
+
+std::uint64_t Read4(const std::uint8_t* p) {
+    std::uint32_t value;
+    std::memcpy(&value, p, 4);
+    return value;
+}
+
+// 1 to 3 bytes
+std::uint64_t Read3(const std::uint8_t* p, std::size_t k) {
+    return (std::uint64_t(p[0]) << 16) | (std::uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+} // anonymous namespace
+
+std::uint64_t Hash(const void* data, std::size_t size) {
+    const auto* p = static_cast<const std::uint8_t*>(data);
+    std::uint64_t seed = secret[0];
+    std::uint64_t a = 0;
+    std::uint64_t b = 0;
+    if (size <= 16) {
+        if (size >= 4) {
+            a = (Read4(p) << 32) | Read4(p + ((size >> 3) << 2));
+            b = (Read4(p + size - 4) << 32) | Read4(p + size - 4 - ((size >> 3) << 2));
+        }
+        else if (size > 0) {
+            a = Read3(p, size);
+        }
+    }
+    else {
+        std::size_t i = size;
+        if (i > 48) {
+            std::uint64_t see1 = seed;
+            std::uint64_t see2 = seed;
+            do {
+                seed = Mix(Read8(p) ^ secret[1], Read8(p + 8) ^ seed);
+                see1 = Mix(Read8(p + 16) ^ secret[2], Read8(p + 24) ^ see1);
+                see2 = Mix(Read8(p + 32) ^ secret[3], Read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = Mix(Read8(p) ^ secret[1], Read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = Read8(p + i - 16);
+        b = Read8(p + i - 8);
+    }
+    return Mix(secret[1] ^ size, Mix(a ^ secret[1], b ^ seed));
+}
+
+} // namespace StableHash